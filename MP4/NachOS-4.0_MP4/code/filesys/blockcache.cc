@@ -0,0 +1,530 @@
+// blockcache.cc
+//	Routines to manage the kernel block cache.
+//
+//	The cache has a fixed number of blocks, each holding one disk
+//	sector.  A hash table on the sector number finds a block in
+//	constant time; when the cache is full, the CLOCK algorithm picks
+//	a block that has not been used recently, writing it back first
+//	if it is dirty.
+//
+//	A lock keeps the cache consistent when several threads use the
+//	file system.  The lock is released while a block is read or
+//	written, so the disk can have requests from several threads
+//	queued at once.  During that time the block is marked busy: it
+//	is already on the hash chain for its new sector, so a second
+//	thread wanting the same sector waits for the first to load it,
+//	rather than loading it twice.
+//
+//	A sector changed inside a journal transaction is pinned: it is
+//	neither evicted nor flushed until the journal has logged it and
+//	committed.
+//
+//	Where the sectors being flushed or batch-loaded are consecutive
+//	on disk, they go to the disk as one multi-sector request.
+//
+//	Read-ahead requests are queued to a kernel thread, which loads
+//	them through the same path as a miss.  A sector read ahead is
+//	left unreferenced, so if the guess was wrong it is the first
+//	thing CLOCK replaces.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "blockcache.h"
+#include "synchdisk.h"
+#include "journal.h"
+#include "main.h"
+
+// The most sectors Evict writes back in one request
+static const int MaxWriteRun = 32;
+
+//----------------------------------------------------------------------
+// BlockCompare
+// 	Order cache blocks by the sector they hold, for Flush.
+//----------------------------------------------------------------------
+
+static int
+BlockCompare(CacheBlock *x, CacheBlock *y)
+{
+    if (x->sector < y->sector)
+        return -1;
+    else if (x->sector > y->sector)
+        return 1;
+    else
+        return 0;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::BlockCache
+// 	Initialize an empty cache of "numBlocks" sectors on top of "disk".
+//----------------------------------------------------------------------
+
+BlockCache::BlockCache(SynchDisk *disk, int size)
+{
+    ASSERT(size > 0);
+    synchDisk = disk;
+    numBlocks = size;
+    blocks = new CacheBlock[numBlocks];
+    buckets = new int[numBlocks];
+    for (int i = 0; i < numBlocks; i++) {
+        blocks[i].sector = -1;
+        blocks[i].dirty = FALSE;
+        blocks[i].referenced = FALSE;
+        blocks[i].busy = FALSE;
+        blocks[i].pinned = FALSE;
+        blocks[i].batched = FALSE;
+        blocks[i].next = -1;
+        buckets[i] = -1;
+    }
+    clockHand = 0;
+    lock = new Lock("block cache");
+    ioDone = new Condition("block cache I/O");
+    readAheadQueue = new List<int>;
+    readAheadPending = new Semaphore("read-ahead pending", 0);
+    journal = NULL;
+
+    Thread *t = new Thread("read-ahead", -1);
+
+    t->Fork(BlockCache::ReadAheadDaemon, this);
+}
+
+//----------------------------------------------------------------------
+// BlockCache::~BlockCache
+// 	Write back anything still dirty, then de-allocate the cache.
+//----------------------------------------------------------------------
+
+BlockCache::~BlockCache()
+{
+    Flush();
+    delete readAheadPending;
+    delete readAheadQueue;
+    delete ioDone;
+    delete lock;
+    delete[] buckets;
+    delete[] blocks;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Find
+// 	Return the block holding "sector", or -1 if it is not cached.
+//----------------------------------------------------------------------
+
+int BlockCache::Find(int sector)
+{
+    for (int i = buckets[sector % numBlocks]; i != -1; i = blocks[i].next)
+        if (blocks[i].sector == sector)
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Unlink
+// 	Remove "block" from the hash chain of the sector it holds.
+//----------------------------------------------------------------------
+
+void BlockCache::Unlink(int block)
+{
+    int *link = &buckets[blocks[block].sector % numBlocks];
+
+    while (*link != block) {
+        ASSERT(*link != -1);
+        link = &blocks[*link].next;
+    }
+    *link = blocks[block].next;
+    blocks[block].next = -1;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Insert
+// 	Make "block" hold "sector", and put it on that sector's hash chain.
+//	The caller fills in the data.
+//----------------------------------------------------------------------
+
+void BlockCache::Insert(int block, int sector)
+{
+    blocks[block].sector = sector;
+    blocks[block].dirty = FALSE;
+    blocks[block].batched = FALSE;
+    blocks[block].next = buckets[sector % numBlocks];
+    buckets[sector % numBlocks] = block;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Evict
+// 	Choose a block to hold a new sector, using the CLOCK algorithm:
+//	sweep the blocks in order, clearing reference bits, and take the
+//	first block that is free or has not been referenced since the last
+//	sweep.  Busy and pinned blocks are skipped.
+//
+//	The chosen block is returned free, unless it is dirty.  Then it is
+//	written back, with the lock released, along with the dirty cached
+//	sectors that follow it on disk (up to MaxWriteRun in all, in one
+//	request, since they will have to be written soon anyway), and
+//	-1 is returned: other
+//	threads may have changed the cache in the meantime, so the caller
+//	has to look again.  -1 is also returned, after waiting, if every
+//	block is busy.
+//----------------------------------------------------------------------
+
+int BlockCache::Evict()
+{
+    int victim = -1;
+
+    for (int i = 0; i < 2 * numBlocks; i++) {
+        int b = clockHand;
+        clockHand = (clockHand + 1) % numBlocks;
+        if (blocks[b].busy || blocks[b].pinned)
+            continue;
+        if (blocks[b].sector == -1 || !blocks[b].referenced) {
+            victim = b;
+            break;
+        }
+        blocks[b].referenced = FALSE;
+    }
+
+    if (victim == -1) {
+        ioDone->Wait(lock);
+        return -1;
+    }
+    if (blocks[victim].dirty) {
+        int run[MaxWriteRun];
+        char *bufs[MaxWriteRun];
+        int sector = blocks[victim].sector;
+        int n = 0, b = victim;
+
+        while (n < MaxWriteRun && sector + n < synchDisk->NumSectors() &&
+               (n == 0 || ((b = Find(sector + n)) != -1 && blocks[b].dirty &&
+                           !blocks[b].busy && !blocks[b].pinned))) {
+            blocks[b].busy = TRUE;
+            run[n] = b;
+            bufs[n++] = blocks[b].data;
+        }
+        DEBUG(dbgFile, "Cache writing back " << n << " sectors from " << sector);
+        lock->Release();
+        synchDisk->WaitFor(synchDisk->WriteRequest(sector, bufs, n));
+        lock->Acquire();
+        for (int i = 0; i < n; i++) {
+            blocks[run[i]].busy = FALSE;
+            blocks[run[i]].dirty = FALSE;
+        }
+        ioDone->Broadcast(lock);
+        return -1;
+    }
+    if (blocks[victim].sector != -1) {
+        Unlink(victim);
+        blocks[victim].sector = -1;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Fetch
+// 	Read the sector "block" now holds from disk.  The lock is released
+//	while the disk works; the block is busy until the data is in.
+//----------------------------------------------------------------------
+
+void BlockCache::Fetch(int block)
+{
+    blocks[block].busy = TRUE;
+    lock->Release();
+    synchDisk->ReadSector(blocks[block].sector, blocks[block].data);
+    lock->Acquire();
+    blocks[block].busy = FALSE;
+    ioDone->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Load
+// 	Return the block holding "sector", bringing it into the cache if
+//	it is not there.  "fetch" is FALSE when the caller is about to
+//	overwrite the whole sector, so there is no point reading it.
+//
+//	Called with the lock held; returns with it held, and the block
+//	not busy.
+//----------------------------------------------------------------------
+
+int BlockCache::Load(int sector, bool fetch)
+{
+    int block;
+
+    for (;;) {
+        block = Find(sector);
+        if (block != -1) {
+            if (!blocks[block].busy) {
+                if (blocks[block].batched) // its miss is counted
+                    blocks[block].batched = FALSE;
+                else
+                    kernel->stats->numCacheHits++;
+                break;
+            }
+            ioDone->Wait(lock); // someone else is loading or writing it
+        } else if ((block = Evict()) != -1) {
+            kernel->stats->numCacheMisses++;
+            Insert(block, sector);
+            if (fetch)
+                Fetch(block);
+            break;
+        }
+    }
+    blocks[block].referenced = TRUE;
+    return block;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadSector
+// 	Copy the contents of a disk sector into "data", from the cache
+//	if possible.
+//
+//	"sectorNumber" -- the disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sector
+//----------------------------------------------------------------------
+
+void BlockCache::ReadSector(int sectorNumber, char *data)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < synchDisk->NumSectors()));
+    lock->Acquire();
+    int block = Load(sectorNumber, TRUE);
+    bcopy(blocks[block].data, data, SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::WriteSector
+// 	Replace the contents of a disk sector.  Only the cached copy is
+//	changed; the disk is updated when the block is written back.
+//	If the calling thread is inside a journal transaction, the journal
+//	logs the sector, and the block is pinned.
+//
+//	"sectorNumber" -- the disk sector to be written
+//	"data" -- the new contents of the disk sector
+//----------------------------------------------------------------------
+
+void BlockCache::WriteSector(int sectorNumber, char *data)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < synchDisk->NumSectors()));
+    bool logged = (journal != NULL && journal->Log(sectorNumber));
+
+    lock->Acquire();
+    int block = Load(sectorNumber, FALSE);
+    bcopy(data, blocks[block].data, SectorSize);
+    blocks[block].dirty = TRUE;
+    if (logged)
+        blocks[block].pinned = TRUE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Unpin
+// 	The journal has committed "sectorNumber", so it may be written
+//	home like any other dirty block.
+//----------------------------------------------------------------------
+
+void BlockCache::Unpin(int sectorNumber)
+{
+    lock->Acquire();
+    int block = Find(sectorNumber);
+    ASSERT(block != -1);
+    blocks[block].pinned = FALSE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Flush
+// 	Write every dirty block back to disk, except pinned ones.  The
+//	blocks stay cached.
+//
+//	All the writes are queued at once, so the disk can do them in
+//	elevator order rather than in the order they sit in the cache.
+//	The dirty blocks are sorted by sector first, and each run of
+//	consecutive sectors is written with one request.  Blocks are busy
+//	until their write is done.
+//----------------------------------------------------------------------
+
+void BlockCache::Flush()
+{
+    SortedList<CacheBlock *> dirty(BlockCompare);
+    CacheBlock **flushing = new CacheBlock *[numBlocks];
+    char **bufs = new char *[numBlocks];
+    DiskRequest **requests = new DiskRequest *[numBlocks];
+    int i, n = 0, runs = 0, runStart = 0;
+
+    lock->Acquire();
+    for (i = 0; i < numBlocks; i++) {
+        if (blocks[i].sector != -1 && blocks[i].dirty && !blocks[i].busy &&
+            !blocks[i].pinned) {
+            blocks[i].busy = TRUE;
+            dirty.Insert(&blocks[i]);
+        }
+    }
+    while (!dirty.IsEmpty()) {
+        CacheBlock *b = dirty.RemoveFront();
+        if (n > runStart && b->sector != flushing[n - 1]->sector + 1) {
+            requests[runs++] = synchDisk->WriteRequest(
+                flushing[runStart]->sector, &bufs[runStart], n - runStart);
+            runStart = n;
+        }
+        flushing[n] = b;
+        bufs[n++] = b->data;
+    }
+    if (n > runStart)
+        requests[runs++] = synchDisk->WriteRequest(
+            flushing[runStart]->sector, &bufs[runStart], n - runStart);
+    lock->Release();
+
+    for (i = 0; i < runs; i++)
+        synchDisk->WaitFor(requests[i]);
+
+    lock->Acquire();
+    for (i = 0; i < n; i++) {
+        flushing[i]->busy = FALSE;
+        flushing[i]->dirty = FALSE;
+    }
+    ioDone->Broadcast(lock);
+    lock->Release();
+    delete[] requests;
+    delete[] bufs;
+    delete[] flushing;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadAhead
+// 	Queue "sectorNumber" for the read-ahead thread and return at once.
+//	Nothing is queued if the sector is cached or queued already, or
+//	if half the cache is already waiting to be read ahead; nothing is
+//	read if the sector is cached by the time the thread gets to it.
+//
+//	"sectorNumber" -- the disk sector the caller expects to read soon
+//----------------------------------------------------------------------
+
+void BlockCache::ReadAhead(int sectorNumber)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < synchDisk->NumSectors()));
+    lock->Acquire();
+    if (Find(sectorNumber) == -1 &&
+        (int)readAheadQueue->NumInList() < numBlocks / 2 &&
+        !readAheadQueue->IsInList(sectorNumber)) {
+        readAheadQueue->Append(sectorNumber);
+        readAheadPending->V();
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadBatch
+// 	Bring every sector in "sectors" into the cache, and return once
+//	they are all in.  The reads of the missing sectors are queued at
+//	once, so the disk can serve them in a single sweep instead of one
+//	seek each.  Sectors out of range are ignored, so a caller checking
+//	a damaged disk can pass pointers it has not validated.
+//
+//	Missing sectors that come one after the other in "sectors" and
+//	are consecutive on disk are read with one multi-sector request.
+//	At most a quarter of the cache is loaded at a time; as with
+//	read-ahead, the blocks are left unreferenced.  The caller is
+//	about to use them, so each sector loaded counts as a miss (and
+//	the caller's first use of it, not as a hit).
+//
+//	"sectors" -- the disk sectors the caller is about to read
+//	"count" -- how many there are
+//----------------------------------------------------------------------
+
+void BlockCache::ReadBatch(int *sectors, int count)
+{
+    int batch = max(numBlocks / 4, 1);
+    DiskRequest **requests = new DiskRequest *[batch];
+    int *loading = new int[batch];
+    char **bufs = new char *[batch];
+
+    for (int first = 0; first < count; first += batch) {
+        int n = 0, runs = 0, runStart = 0;
+
+        lock->Acquire();
+        for (int i = first; i < min(count, first + batch); i++) {
+            int sector = sectors[i], block = -1;
+
+            if (sector < 0 || sector >= synchDisk->NumSectors())
+                continue;
+            while (Find(sector) == -1 && (block = Evict()) == -1)
+                ;
+            if (block == -1)
+                continue; // already cached
+            Insert(block, sector);
+            blocks[block].referenced = FALSE;
+            blocks[block].busy = TRUE;
+            if (n > runStart && sector != blocks[loading[n - 1]].sector + 1) {
+                requests[runs++] = synchDisk->ReadRequest(
+                    blocks[loading[runStart]].sector, &bufs[runStart],
+                    n - runStart);
+                runStart = n;
+            }
+            bufs[n] = blocks[block].data;
+            loading[n++] = block;
+            blocks[block].batched = TRUE;
+            kernel->stats->numCacheMisses++;
+        }
+        if (n > runStart)
+            requests[runs++] = synchDisk->ReadRequest(
+                blocks[loading[runStart]].sector, &bufs[runStart],
+                n - runStart);
+        lock->Release();
+
+        for (int i = 0; i < runs; i++)
+            synchDisk->WaitFor(requests[i]);
+
+        lock->Acquire();
+        for (int i = 0; i < n; i++)
+            blocks[loading[i]].busy = FALSE;
+        ioDone->Broadcast(lock);
+        lock->Release();
+    }
+    delete[] bufs;
+    delete[] loading;
+    delete[] requests;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Prefetch
+// 	Bring "sector" into the cache if it is not already there.  This
+//	is not counted as a hit or a miss; a later read of the sector is.
+//----------------------------------------------------------------------
+
+void BlockCache::Prefetch(int sector)
+{
+    int block;
+
+    lock->Acquire();
+    while (Find(sector) == -1) {
+        if ((block = Evict()) != -1) {
+            Insert(block, sector);
+            blocks[block].referenced = FALSE;
+            Fetch(block);
+            kernel->stats->numReadAheads++;
+        }
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadAheadDaemon
+// 	Body of the read-ahead thread: wait for sectors on the queue, and
+//	load each one.  The thread blocks when the queue is empty, so it
+//	does not keep Nachos from halting.
+//
+//	"arg" -- the BlockCache to fill
+//----------------------------------------------------------------------
+
+void BlockCache::ReadAheadDaemon(void *arg)
+{
+    BlockCache *cache = (BlockCache *)arg;
+    int sector;
+
+    for (;;) {
+        cache->readAheadPending->P();
+        cache->lock->Acquire();
+        sector = cache->readAheadQueue->RemoveFront();
+        cache->lock->Release();
+        cache->Prefetch(sector);
+    }
+}
@@ -0,0 +1,112 @@
+// blockcache.h
+//	Data structures for a kernel cache of disk sectors, sitting
+//	between the file system and the synchronous disk.
+//
+//	Every file header, index block, directory, bitmap and file data
+//	sector the file system touches goes through the cache.  Reads
+//	that hit do not go to the disk at all; writes only mark the
+//	cached copy dirty, and reach the disk when the block is evicted
+//	or when the cache is flushed.
+//
+//	Files being read sequentially can ask for sectors ahead of the
+//	reader; a read-ahead thread brings them into the cache while the
+//	reader is still busy with the data it already has.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "disk.h"
+#include "synch.h"
+#include "list.h"
+#include "journal.h"
+
+class SynchDisk;
+
+#define DefaultCacheBlocks 256	// cache size when not given with -bc
+#define MinCacheBlocks (2 * JournalOpBlocks) // smallest cache that holds
+                                // a full journal with room to spare
+
+// The following class defines one cached disk sector.
+
+class CacheBlock
+{
+public:
+    int sector;      // Disk sector held here, -1 if the block is free
+    bool dirty;      // Modified since it was read from disk?
+    bool referenced; // Used since the clock hand last passed?
+    bool busy;       // Being read or written by the disk?
+    bool pinned;     // Changed inside a journal transaction that has
+                     // not committed, so must not be written home
+    bool batched;    // Loaded by ReadBatch, and counted as a miss
+                     // then, but not yet used by the caller
+    int next;        // Next block in the same hash bucket, -1 ends
+    char data[SectorSize];
+};
+
+// The following class defines the block cache.  Blocks are found
+// through a hash table on the sector number, and replaced with the
+// CLOCK algorithm (an approximation of LRU).  Dirty blocks are written
+// back when they are replaced, and by Flush.
+//
+// The cache lock is not held while the disk works, so other threads can
+// use the cache, or queue their own disk requests, in the meantime.  A
+// block is marked busy for the length of its I/O; anyone else who needs
+// it waits on ioDone.
+
+class BlockCache
+{
+public:
+    BlockCache(SynchDisk *disk, int numBlocks); // Initialize an empty cache
+    ~BlockCache();                              // Flush and de-allocate
+
+    void ReadSector(int sectorNumber, char *data);  // Same interface as
+    void WriteSector(int sectorNumber, char *data); // the SynchDisk
+
+    void Flush(); // Write every dirty block back to disk
+
+    void ReadAhead(int sectorNumber); // Ask the read-ahead thread to bring
+                                      // "sectorNumber" into the cache
+    void ReadBatch(int *sectors, int count); // Bring a list of sectors
+                                             // into the cache, with the
+                                             // reads queued together
+
+    void SetJournal(Journal *j) { journal = j; } // Log changes made
+                                                 // inside transactions
+    void Unpin(int sectorNumber); // "sectorNumber" is committed; let it
+                                  // be written home
+    int NumBlocks() { return numBlocks; }
+
+private:
+    SynchDisk *synchDisk; // Disk below the cache
+    int numBlocks;        // Number of blocks in the cache
+    CacheBlock *blocks;   // The cached sectors
+    int *buckets;         // Hash table: first block in each chain
+    int clockHand;        // Next block the CLOCK policy looks at
+    Lock *lock;           // Only one thread in the cache at a time
+    Condition *ioDone;    // Signalled when a busy block is done
+    List<int> *readAheadQueue;     // Sectors waiting to be read ahead
+    Semaphore *readAheadPending;   // Counts the sectors on the queue
+    Journal *journal;              // Where changed sectors are logged,
+                                   // or NULL
+
+    int Find(int sector);             // Block holding "sector", or -1
+    int Load(int sector, bool fetch); // Get a block for "sector", reading
+                                      // it from disk if "fetch"
+    int Evict();                      // Pick a block to replace, or -1
+                                      // if the caller must look again
+    void Fetch(int block);            // Read a block's sector from disk
+    void Unlink(int block);           // Take a block off its hash chain
+    void Insert(int block, int sector); // Put a block on the hash chain
+                                        // for "sector"
+    void Prefetch(int sector);          // Load "sector" if not cached
+
+    static void ReadAheadDaemon(void *arg); // Body of the read-ahead thread
+};
+
+#endif // BLOCKCACHE_H
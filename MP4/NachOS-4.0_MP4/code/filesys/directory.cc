@@ -7,23 +7,44 @@
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
+//	The table is a hash table of one-sector buckets, with linear
+//	probing from bucket to bucket.  Instead of leaving tombstones
+//	when a name is removed, each bucket counts how many names probed
+//	past it; a lookup stops at the first bucket with a zero count.
+//	A name is never put more than DirProbeLimit buckets from its home,
+//	so adding or removing one changes only a few sectors.
+//
+//	When the table is three quarters full, or a name has no room near
+//	its home, every name is rehashed into a table twice as big.  The
+//	new table goes in the directory file right after the old one, and
+//	the header sector says where the table starts, so the old table
+//	stays intact on disk until the header is written.  The file system
+//	writes the new table a few buckets at a time, then the header,
+//	then frees the old one.
+//
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "utility.h"
+#include "debug.h"
 #include "filehdr.h"
 #include "directory.h"
-#define NumDirEntries 64 ///MP4 一個dir 最多只能放64個檔案或dir
+#include "inodetable.h"
+#include "main.h"
+#include "blockcache.h"
+#define NumDirEntries 64 ///MP4 一個dir 一開始能放的檔案或dir 數量
+
+#define BucketAbsent 0 // not read from disk yet
+#define BucketClean 1  // same as on disk
+#define BucketDirty 2  // changed since it was read
+
+#define MaxLoad(buckets) ((buckets) * DirEntriesPerBucket * 3 / 4)
 //----------------------------------------------------------------------
 // Directory::Directory
 // 	Initialize a directory; initially, the directory is completely
@@ -36,14 +57,10 @@
 
 Directory::Directory(int size)
 {
-    table = new DirectoryEntry[size];
-
-    // MP4 mod tag
-    memset(table, 0, sizeof(DirectoryEntry) * size); // dummy operation to keep valgrind happy
-
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-        table[i].inUse = FALSE;
+    buckets = NULL;
+    bucketState = NULL;
+    file = NULL;
+    Reset(divRoundUp(size, DirEntriesPerBucket));
 }
 
 //----------------------------------------------------------------------
@@ -53,31 +70,165 @@ Directory::Directory(int size)
 
 Directory::~Directory()
 {
-    delete[] table;
+    delete[] buckets;
+    delete[] bucketState;
+}
+
+//----------------------------------------------------------------------
+// Directory::Reset
+// 	Throw away the in-core contents, and start over with "size" empty
+//	buckets, all of which need writing.
+//----------------------------------------------------------------------
+
+void Directory::Reset(int size)
+{
+    delete[] buckets;
+    delete[] bucketState;
+
+    numBuckets = size;
+    numEntries = 0;
+    firstBucket = 1;
+    buckets = new DirectoryBucket[numBuckets];
+    bucketState = new char[numBuckets];
+
+    // MP4 mod tag
+    memset(buckets, 0, sizeof(DirectoryBucket) * numBuckets); // dummy operation to keep valgrind happy
+
+    for (int i = 0; i < numBuckets; i++) {
+        for (int j = 0; j < DirEntriesPerBucket; j++)
+            buckets[i].entries[j].inUse = FALSE;
+        buckets[i].overflow = 0;
+        bucketState[i] = BucketDirty;
+    }
+    headerDirty = TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the header of the directory from disk.  The buckets are read
+//	later, as they are needed.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
-void Directory::FetchFrom(OpenFile *file)
+void Directory::FetchFrom(OpenFile *from)
 {
-    (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int header[SectorSize / sizeof(int)];
+
+    (void)from->ReadAt((char *)header, SectorSize, 0);
+    Reset(header[0]);
+    numEntries = header[1];
+    firstBucket = header[2];
+    for (int i = 0; i < numBuckets; i++)
+        bucketState[i] = BucketAbsent;
+    headerDirty = FALSE;
+    file = from;
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  Only the
+//	buckets that changed are written, unless the directory is going
+//	to a different file than it came from.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
-void Directory::WriteBack(OpenFile *file)
+void Directory::WriteBack(OpenFile *to)
 {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    bool all = (to != file);
+    char buf[SectorSize];
+
+    ASSERT(to->Length() >= (firstBucket + numBuckets) * SectorSize);
+    for (int i = 0; i < numBuckets; i++) {
+        if (all || bucketState[i] == BucketDirty) {
+            memset(buf, 0, SectorSize);
+            bcopy((char *)GetBucket(i), buf, sizeof(DirectoryBucket));
+            (void)to->WriteAt(buf, SectorSize, (firstBucket + i) * SectorSize);
+            bucketState[i] = BucketClean;
+        }
+    }
+    if (all || headerDirty) {
+        int header[SectorSize / sizeof(int)];
+        memset(header, 0, SectorSize);
+        header[0] = numBuckets;
+        header[1] = numEntries;
+        header[2] = firstBucket;
+        (void)to->WriteAt((char *)header, SectorSize, 0);
+        headerDirty = FALSE;
+    }
+    file = to;
+}
+
+//----------------------------------------------------------------------
+// Directory::WriteBuckets
+// 	Write up to "count" of the buckets that changed back to the file
+//	the directory was fetched from, but not the header.  Return how
+//	many were written; zero means none are left.  Used to write a
+//	grown table a few buckets at a time.
+//----------------------------------------------------------------------
+
+int Directory::WriteBuckets(int count)
+{
+    char buf[SectorSize];
+    int n = 0;
+
+    ASSERT(file->Length() >= (firstBucket + numBuckets) * SectorSize);
+    for (int i = 0; i < numBuckets && n < count; i++) {
+        if (bucketState[i] == BucketDirty) {
+            memset(buf, 0, SectorSize);
+            bcopy((char *)&buckets[i], buf, sizeof(DirectoryBucket));
+            (void)file->WriteAt(buf, SectorSize, (firstBucket + i) * SectorSize);
+            bucketState[i] = BucketClean;
+            n++;
+        }
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------
+// Directory::GetBucket
+// 	Return bucket "b", reading it from the directory file the first
+//	time it is used.
+//----------------------------------------------------------------------
+
+DirectoryBucket *Directory::GetBucket(int b)
+{
+    ASSERT(b >= 0 && b < numBuckets);
+    if (bucketState[b] == BucketAbsent) {
+        char buf[SectorSize];
+        (void)file->ReadAt(buf, SectorSize, (firstBucket + b) * SectorSize);
+        bcopy(buf, (char *)&buckets[b], sizeof(DirectoryBucket));
+        bucketState[b] = BucketClean;
+    }
+    return &buckets[b];
+}
+
+//----------------------------------------------------------------------
+// Directory::Entry
+// 	Return entry "index" of the table; entries are numbered bucket by
+//	bucket.
+//----------------------------------------------------------------------
+
+DirectoryEntry *Directory::Entry(int index)
+{
+    return &GetBucket(index / DirEntriesPerBucket)->entries[index % DirEntriesPerBucket];
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash
+// 	Return the home bucket of a file name (FNV-1a over its characters).
+//----------------------------------------------------------------------
+
+int Directory::Hash(char *name)
+{
+    unsigned int h = 2166136261u;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h % numBuckets;
 }
 
 //----------------------------------------------------------------------
@@ -90,9 +241,17 @@ void Directory::WriteBack(OpenFile *file)
 
 int Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-            return i;
+    int b = Hash(name);
+
+    for (int probes = 0; probes < numBuckets; probes++) {
+        DirectoryBucket *bucket = GetBucket(b);
+        for (int j = 0; j < DirEntriesPerBucket; j++)
+            if (bucket->entries[j].inUse && !strncmp(bucket->entries[j].name, name, FileNameMaxLen))
+                return b * DirEntriesPerBucket + j;
+        if (bucket->overflow == 0)
+            break; // nothing with this hash went further
+        b = (b + 1) % numBuckets;
+    }
     return -1; // name not in directory
 }
 
@@ -103,61 +262,157 @@ int Directory::FindIndex(char *name)
 //	in the directory.
 //
 //	"name" -- the file name to look up
+//	"fileType" -- if not NULL, set to the type of the entry found
 //----------------------------------------------------------------------
 
-int Directory::Find(char *name, bool need_find_sub_dir)
+int Directory::Find(char *name, int *fileType)
 {
     int i = FindIndex(name);
 
-    if (i != -1)return table[i].sector;
-    else{
-        //cout<<"part3\n";
-        if(need_find_sub_dir){
-            int result = -1;
-			for(int j=0; j<tableSize; j++){
-				if(table[j].inUse && (table[j].type==DIR)){
-					Directory* next_directory = new Directory(NumDirEntries);
-					OpenFile* next_directory_files = new OpenFile(table[j].sector);
-					next_directory->FetchFrom(next_directory_files);
-					result = next_directory->Find(name, true);
-					delete next_directory;
-					delete next_directory_files;
-				}
-				if(result != -1){
-					return result;
-				}
-			}
-        }
+    if (i == -1)
+        return -1; // name not in directory
+    if (fileType != NULL)
+        *fileType = Entry(i)->type;
+    return Entry(i)->sector;
+}
+
+//----------------------------------------------------------------------
+// Directory::Place
+// 	Return the bucket a new "name" would go in: the first one with a
+//	free entry, starting from its home bucket, and at most
+//	DirProbeLimit buckets along.  Return -1 if there is none.
+//----------------------------------------------------------------------
+
+int Directory::Place(char *name)
+{
+    int b = Hash(name);
+
+    for (int probes = 0; probes < min(DirProbeLimit, numBuckets); probes++) {
+        DirectoryBucket *bucket = GetBucket(b);
+        for (int j = 0; j < DirEntriesPerBucket; j++)
+            if (!bucket->entries[j].inUse)
+                return b;
+        b = (b + 1) % numBuckets;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Insert
+// 	Put a name in the bucket Place picks, and count it in the overflow
+//	of every full bucket passed on the way.  Return the index of the
+//	new entry, or -1 if there is no room near the name's home.
+//----------------------------------------------------------------------
+
+int Directory::Insert(char *name, int newSector, int fileType)
+{
+    int b = Place(name);
+    DirectoryBucket *bucket;
+
+    if (b == -1)
+        return -1;
+    for (int p = Hash(name); p != b; p = (p + 1) % numBuckets) {
+        buckets[p].overflow++;
+        bucketState[p] = BucketDirty;
     }
+    bucket = &buckets[b];
+    bucketState[b] = BucketDirty;
+    for (int j = 0; j < DirEntriesPerBucket; j++)
+        if (!bucket->entries[j].inUse) {
+            bucket->entries[j].inUse = TRUE;
+            strncpy(bucket->entries[j].name, name, FileNameMaxLen);
+            bucket->entries[j].name[FileNameMaxLen] = '\0';
+            bucket->entries[j].sector = newSector;
+            bucket->entries[j].type = fileType;///MP4 mod
+            numEntries++;
+            headerDirty = TRUE;
+            return b * DirEntriesPerBucket + j;
+        }
+    ASSERTNOTREACHED();
     return -1;
 }
 
+//----------------------------------------------------------------------
+// Directory::Crowded
+// 	Return TRUE if the directory should grow before "name" is added:
+//	it is three quarters full, or there is no room near the name's
+//	home bucket.
+//----------------------------------------------------------------------
+
+bool Directory::Crowded(char *name)
+{
+    return numEntries + 1 > MaxLoad(numBuckets) || Place(name) == -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Grow
+// 	Rehash every name into a table of twice as many buckets, placed in
+//	the directory file just after the current one.  Only the in-core
+//	copy changes; every bucket and the header need writing, and the
+//	caller must make sure the file has sectors for the new table.
+//	Return FALSE, changing nothing, if some name cannot be placed
+//	near its home even in the bigger table.
+//----------------------------------------------------------------------
+
+bool Directory::Grow()
+{
+    DirectoryBucket *oldBuckets;
+    char *oldState;
+    int oldSize = numBuckets, oldFirst = firstBucket;
+    bool oldDirty = headerDirty;
+    DirectoryEntry *saved = new DirectoryEntry[numEntries];
+    int n = 0, i, j;
+
+    for (i = 0; i < oldSize; i++)
+        for (j = 0; j < DirEntriesPerBucket; j++)
+            if (GetBucket(i)->entries[j].inUse)
+                saved[n++] = GetBucket(i)->entries[j];
+    ASSERT(n == numEntries);
+    DEBUG(dbgFile, "Growing directory to " << 2 * oldSize << " buckets");
+
+    oldBuckets = buckets;
+    oldState = bucketState;
+    buckets = NULL;
+    bucketState = NULL;
+    Reset(2 * oldSize);
+    firstBucket = oldFirst + oldSize;
+    for (i = 0; i < n; i++)
+        if (Insert(saved[i].name, saved[i].sector, saved[i].type) == -1)
+            break;
+    delete[] saved;
+
+    if (i < n) { // put the old table back
+        delete[] buckets;
+        delete[] bucketState;
+        buckets = oldBuckets;
+        bucketState = oldState;
+        numBuckets = oldSize;
+        numEntries = n;
+        firstBucket = oldFirst;
+        headerDirty = oldDirty;
+        return FALSE;
+    }
+    delete[] oldBuckets;
+    delete[] oldState;
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
 //	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	there is no room for it; see Crowded.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"fileType" -- FILE or DIR
 //----------------------------------------------------------------------
 
 bool Directory::Add(char *name, int newSector, int fileType)
 {
     if (FindIndex(name) != -1)
         return FALSE;
-
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse)
-        {
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
-            table[i].type = fileType;///MP4 mod
-            return TRUE;
-        }
-    return FALSE; // no space.  Fix when we have extensible files.
+    return Insert(name, newSector, fileType) != -1;
 }
 
 //----------------------------------------------------------------------
@@ -165,17 +420,29 @@ bool Directory::Add(char *name, int newSector, int fileType)
 // 	Remove a file name from the directory.  Return TRUE if successful;
 //	return FALSE if the file isn't in the directory.
 //
+//	The buckets between the name's home and where it was found no
+//	longer have it pushed past them, so their overflow goes down.
+//
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool Directory::Remove(char *name, bool is_remove_file)
 {
     int i = FindIndex(name);
-    if(is_remove_file && table[i].type==DIR)return FALSE;
-    
+
     if (i == -1)
         return FALSE; // name not in directory
-    table[i].inUse = FALSE;
+    if(is_remove_file && Entry(i)->type==DIR)return FALSE;
+
+    int found = i / DirEntriesPerBucket;
+    for (int b = Hash(name); b != found; b = (b + 1) % numBuckets) {
+        GetBucket(b)->overflow--;
+        bucketState[b] = BucketDirty;
+    }
+    Entry(i)->inUse = FALSE;
+    bucketState[found] = BucketDirty;
+    numEntries--;
+    headerDirty = TRUE;
     return TRUE;
 }
 
@@ -186,28 +453,87 @@ bool Directory::Remove(char *name, bool is_remove_file)
 ///MP4Mod
 void Directory::List(int depth, bool lr_flag)
 {
-    for (int i = 0; i < tableSize; i++){
-        if (table[i].inUse){
+    for (int i = 0; i < numBuckets * DirEntriesPerBucket; i++){
+        DirectoryEntry *entry = Entry(i);
+        if (entry->inUse){
             
-            if(table[i].type==FILE){
+            if(entry->type==FILE){
                 for(int j=0;j<depth;j++)cout<<"   ";
-                cout<<"[F] "<<table[i].name<<"\n";
+                cout<<"[F] "<<entry->name<<"\n";
             }
-            else if(table[i].type==DIR){
+            else if(entry->type==DIR){
                 for(int j=0;j<depth;j++)cout<<"   ";
-                cout<<"[D] "<<table[i].name<<"\n";
+                cout<<"[D] "<<entry->name<<"\n";
                 if(lr_flag){
                     Directory* next_directory = new Directory(NumDirEntries);
-                    OpenFile* next_directory_files = new OpenFile(table[i].sector);
+                    OpenFile* next_directory_files = new OpenFile(entry->sector);
                     next_directory->FetchFrom(next_directory_files);
                     int next_depth = depth+1;
                     next_directory->List(next_depth, true);
+                    delete next_directory;
+                    delete next_directory_files;
                 }
             }
         }
     }
 }
 
+//----------------------------------------------------------------------
+// Directory::Check
+// 	For the consistency checker: claim in "used" the header and the
+//	sectors of every file and directory under this one, recursively.
+//	Return the number of names found, and add to "bad" the number of
+//	sectors that were invalid or claimed twice.  A header that was
+//	claimed already is not followed, so a directory linked into
+//	itself cannot loop.
+//
+//	The headers of all the names in the directory are read as one
+//	batch before any of them is looked at.
+//
+//	"used" -- the bit map of sectors found in use so far
+//	"bad" -- the count of bad sectors found so far
+//----------------------------------------------------------------------
+
+int Directory::Check(PersistentBitmap *used, int *bad)
+{
+    int *sectors = new int[numEntries];
+    int numNames = 0;
+    int i, n = 0;
+
+    for (i = 0; i < numBuckets * DirEntriesPerBucket && n < numEntries; i++)
+        if (Entry(i)->inUse)
+            sectors[n++] = Entry(i)->sector;
+    kernel->blockCache->ReadBatch(sectors, n);
+    delete[] sectors;
+
+    for (i = 0; i < numBuckets * DirEntriesPerBucket; i++) {
+        DirectoryEntry *entry = Entry(i);
+        if (!entry->inUse)
+            continue;
+        numNames++;
+        if (entry->sector < 0 || entry->sector >= used->NumItems() ||
+            used->Test(entry->sector)) {
+            (*bad)++;
+            continue;
+        }
+        used->Mark(entry->sector);
+
+        FileHeader *hdr = kernel->inodeTable->Acquire(entry->sector);
+        *bad += hdr->Claim(used);
+        kernel->inodeTable->Release(entry->sector);
+
+        if (entry->type == DIR) {
+            Directory *sub = new Directory(NumDirEntries);
+            OpenFile *subFile = new OpenFile(entry->sector);
+            sub->FetchFrom(subFile);
+            numNames += sub->Check(used, bad);
+            delete sub;
+            delete subFile;
+        }
+    }
+    return numNames;
+}
+
 //----------------------------------------------------------------------
 // Directory::Print
 // 	List all the file names in the directory, their FileHeader locations,
@@ -218,39 +544,14 @@ void Directory::Print()
 {
     FileHeader *hdr = new FileHeader;
 
-    printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
+    printf("Directory contents: %d names in %d buckets\n", numEntries, numBuckets);
+    for (int i = 0; i < numBuckets * DirEntriesPerBucket; i++)
+        if (Entry(i)->inUse)
         {
-            printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-            hdr->FetchFrom(table[i].sector);
+            printf("Name: %s, Sector: %d\n", Entry(i)->name, Entry(i)->sector);
+            hdr->FetchFrom(Entry(i)->sector);
             hdr->Print();
         }
     printf("\n");
     delete hdr;
 }
-
-bool Directory::remove_all_object(PersistentBitmap* freeMap, OpenFile* delete_file){
-	for(int i=0;i<tableSize;i++){
-        if(table[i].inUse){
-            if(table[i].type==DIR){
-                ////delete inside dir first
-                Directory* next_directory = new Directory(NumDirEntries);
-                OpenFile* next_directory_files = new OpenFile(table[i].sector);
-                next_directory->FetchFrom(next_directory_files);
-                next_directory->remove_all_object(freeMap, next_directory_files);
-                delete next_directory;
-                delete next_directory_files;
-            }
-
-            FileHeader *hdr = new FileHeader;
-            hdr->FetchFrom(table[i].sector);
-            table[i].inUse = false;
-            hdr->Deallocate(freeMap);
-            freeMap->Clear(table[i].sector);
-            delete hdr;
-        }
-    }
-    this->WriteBack(delete_file);
-}
-
@@ -6,6 +6,14 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	The table is a hash table on the file name, split into buckets
+//	of one disk sector each, so looking up a name only reads the
+//	sectors on its probe sequence (usually just one).  The table
+//	doubles when it gets too full, so a directory can hold any
+//	number of files.  A name is kept within DirProbeLimit buckets of
+//	its home, so adding or removing one changes at most that many
+//	buckets and the header.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -18,6 +26,7 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#include "pbitmap.h"
 
 #define FileNameMaxLen 9 // for simplicity, we assume \
                          // file names are <= 9 characters long
@@ -42,15 +51,37 @@ public:
     int type; //判別是FILE 還是 DIRECTORY 
 };
 
+// The following class defines one bucket of the directory hash table,
+// stored in a single disk sector.  A name goes in the bucket its hash
+// picks, or if that one is full, the next bucket with a free entry.
+// "overflow" counts the names that were pushed past this bucket that
+// way; when it is zero, a lookup can stop here.
+
+#define DirEntriesPerBucket ((int)((SectorSize - sizeof(int)) / sizeof(DirectoryEntry)))
+#define DirProbeLimit 8 // most buckets looked at for a free entry
+
+class DirectoryBucket
+{
+public:
+    DirectoryEntry entries[DirEntriesPerBucket];
+    int overflow; // Names living in later buckets that
+                  // hashed to this one or earlier
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
 // The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
+// When it is on disk, it is stored as a regular Nachos file: a header
+// sector with the number of buckets and entries and the sector of the
+// file where the buckets start, then the buckets.  Any sectors of the
+// file before them are holes, or a table being replaced.
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk.
+// from/to disk.  FetchFrom only reads the header sector; buckets are
+// read when a lookup needs them, and WriteBack only writes the ones
+// that changed.
 
 class Directory
 {
@@ -62,14 +93,29 @@ public:
     void FetchFrom(OpenFile *file); // Init directory contents from disk
     void WriteBack(OpenFile *file); // Write modifications to
                                     // directory contents back to disk
-
-    int Find(char *name, bool find_sub_dir); // Find the sector number of the
-                          // FileHeader for file: "name"
-
-    bool Add(char *name, int newSector, int fileType); // Add a file name into the directory
+    int WriteBuckets(int count);    // Write back a few of the changed
+                                    // buckets, but not the header
+
+    int Find(char *name, int *fileType = NULL);
+                          // Find the sector number of the
+                          // FileHeader for file: "name",
+                          // and whether it is a FILE or DIR
+
+    bool Add(char *name, int newSector, int fileType); // Add a file name
+                          // into the directory
+    bool Crowded(char *name); // Should it grow before "name" is added?
+    bool Grow();          // Rehash into twice as many buckets, in core
+    int FirstBucket() { return firstBucket; } // Where the table starts
+    int NumBuckets() { return numBuckets; }   // and how long it is,
+                                              // in sectors of the file
 
     bool Remove(char *name, bool is_remove_file); // Remove a file from the directory
-    bool remove_all_object(PersistentBitmap* freeMap, OpenFile *delete_file); // recusive remove
+    int NumSlots() { return numBuckets * DirEntriesPerBucket; }
+    DirectoryEntry *Entry(int index); // Entry "index" of the table,
+                                      // in use or not
+    int Check(PersistentBitmap *used, int *bad); // Claim the sectors of
+                                                 // everything under this
+                                                 // directory (fsck)
 
     void List(int depth, bool lr_flag);  // Print the names of all the files
                   //  in the directory
@@ -82,13 +128,28 @@ private:
     /*
 		MP4 Hint:
 		Directory is actually a "file", be careful of how it works with OpenFile and FileHdr.
-		Disk part: table
-		In-core part: tableSize
+		Disk part: numBuckets, numEntries, firstBucket, buckets
+		In-core part: file, bucketState, headerDirty
 	*/
 
-    int tableSize;         // Number of directory entries
-    DirectoryEntry *table; // Table of pairs:
-                           // <file name, file header location>
+    OpenFile *file;           // File the directory was fetched from,
+                              // NULL for a new directory
+    int numBuckets;           // Number of buckets in the hash table
+    int numEntries;           // Number of names in the directory
+    int firstBucket;          // Sector of the file holding bucket 0
+    DirectoryBucket *buckets; // In-core copy of each bucket
+    char *bucketState;        // Whether each bucket has been read,
+                              // and whether it has changed since
+    bool headerDirty;         // numBuckets/numEntries/firstBucket
+                              // changed?
+
+    void Reset(int size);          // Discard the contents, and make
+                                   // "size" empty buckets
+    DirectoryBucket *GetBucket(int b); // Bucket "b", read in if need be
+    int Hash(char *name);          // Home bucket of "name"
+    int Place(char *name);         // Bucket a new "name" would go in
+    int Insert(char *name, int newSector, int fileType); // Put a name
+                                   // in its bucket, without checks
 
     int FindIndex(char *name); // Find the index into the directory
                                //  table corresponding to "name"
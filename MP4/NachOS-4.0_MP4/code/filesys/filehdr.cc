@@ -3,12 +3,12 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	file's data is stored.  We implement this as a multi-level
+//	index, as in UNIX: a table of direct pointers to data sectors,
+//	followed by the roots of a single-indirect block, a double-indirect
+//	tree and several triple-indirect trees.  Each index block is a
+//	full sector of sector numbers.  The header itself is chosen to be
+//	exactly one disk sector.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -26,9 +26,78 @@
 
 #include "filehdr.h"
 #include "debug.h"
-#include "synchdisk.h"
+#include "blockcache.h"
+#include "synch.h"
 #include "main.h"
 
+#define NumIndexTrees (2 + NumTripleIndirect)	// single, double, then the triples
+
+//----------------------------------------------------------------------
+// TreeSpan
+//	Number of data sectors reachable through an index tree of "depth"
+//	levels (depth 0 is a single data sector).
+//----------------------------------------------------------------------
+
+static int
+TreeSpan(int depth)
+{
+	int span = 1;
+	for (int i = 0; i < depth; i++)
+		span *= NumIndirect;
+	return span;
+}
+
+//----------------------------------------------------------------------
+// TreeSectors
+//	Number of index blocks needed by a "depth" level tree holding
+//	"count" data sectors.  Trees are always filled from the left,
+//	so each level needs just enough blocks to cover "count".
+//----------------------------------------------------------------------
+
+static int
+TreeSectors(int count, int depth)
+{
+	int total = 0;
+	for (int level = 1; level <= depth; level++)
+		total += divRoundUp(count, TreeSpan(level));
+	return total;
+}
+
+//----------------------------------------------------------------------
+// TreeDepth
+//	Depth of index tree "tree": 0 is the single-indirect block, 1 the
+//	double-indirect tree, and the rest are triple-indirect.
+//----------------------------------------------------------------------
+
+static int
+TreeDepth(int tree)
+{
+	return (tree < 2) ? tree + 1 : 3;
+}
+
+//----------------------------------------------------------------------
+// IndexSectors
+//	Number of index blocks needed by a file of "count" data sectors:
+//	none for the direct pointers, then whatever each tree holding
+//	part of the file needs.
+//----------------------------------------------------------------------
+
+static int
+IndexSectors(int count)
+{
+	int remain = max(count - NumDirect, 0);
+	int total = 0;
+	int depth, n;
+
+	for (int i = 0; i < NumIndexTrees && remain > 0; i++) {
+		depth = TreeDepth(i);
+		n = min(remain, TreeSpan(depth));
+		total += TreeSectors(n, depth);
+		remain -= n;
+	}
+	return total;
+}
+
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::FileHeader
@@ -38,25 +107,46 @@
 //----------------------------------------------------------------------
 FileHeader::FileHeader()
 {
-	next_hdf = NULL;///MP4 bo
-	next_hdf_sector = -1;///MP4 bo
-
 	numBytes = -1;
 	numSectors = -1;
 	memset(dataSectors, -1, sizeof(dataSectors));
+	singleIndirect = EmptySector;
+	doubleIndirect = EmptySector;
+	memset(tripleIndirect, -1, sizeof(tripleIndirect));
+	for (int i = 0; i < 3; i++)
+		cachedIndex[i] = EmptySector;
+	runStart = EmptySector;
+	runLength = 0;
+	runWanted = 0;
+	lock = new Lock("file header");
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	The in-core index cache is part of the object, so only the lock
+//	needs freeing.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader()
 {
-	// nothing to do now
-	if(next_hdf!=NULL) delete next_hdf;
+	delete lock;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TreeRoot
+//	Return the header slot holding the root of index tree "tree"
+//	(0 is the single-indirect block, 1 the double-indirect tree,
+//	and the rest are triple-indirect), and its depth.
+//----------------------------------------------------------------------
+
+int *FileHeader::TreeRoot(int tree, int *depth)
+{
+	*depth = TreeDepth(tree);
+	if (tree == 0)
+		return &singleIndirect;
+	if (tree == 1)
+		return &doubleIndirect;
+	return &tripleIndirect[tree - 2];
 }
 
 //----------------------------------------------------------------------
@@ -64,89 +154,506 @@ FileHeader::~FileHeader()
 // 	Initialize a fresh file header for a newly created file.
 //	Allocate data blocks for the file out of the map of free disk blocks.
 //	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+//	the new file; in that case nothing is taken from the map.
 //
 //	"freeMap" is the bit map of free disk sectors
-//	"fileSize" is the bit map of free disk sectors
+//	"fileSize" is the size of the file in bytes
 //----------------------------------------------------------------------
 ///MP4 mod
-bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize) ///MP4 mod: indexed allocation 
-{	
-	/*=====================indexed Alocation===========================*/
-	/*cout<<"max sectors: "<<NumSectors<<"\n";
+bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize) ///MP4 mod: multi-level index
+{
+	int remain, needed, depth, n, i;
+
 	numBytes = fileSize;
-	numSectors = divRoundUp(fileSize, SectorSize); ///切分成一個一個 sectors
-	cout<<"need: "<<numSectors<<" sectors\n";
-	if (freeMap->NumClear() < numSectors){
+	numSectors = divRoundUp(fileSize, SectorSize);
+	if (numSectors > MaxDataSectors)
+		return FALSE; // file too big for the index
+
+	// count the data sectors plus every index block on the way
+	needed = numSectors + IndexSectors(numSectors);
+	if (freeMap->NumClear() < needed)
 		return FALSE; // not enough space
-	}
-	/*for (int i = 0; i < numSectors; i++)
-	{
-		dataSectors[i] = freeMap->FindAndSet();
+
+	for (i = 0; i < 3; i++)
+		cachedIndex[i] = EmptySector;
+	runLength = 0;
+	runWanted = needed;
+	remain = numSectors;
+	for (i = 0; i < NumDirect && remain > 0; i++, remain--) {
+		dataSectors[i] = NextSector(freeMap);
 		// since we checked that there was enough free space,
 		// we expect this to succeed
 		ASSERT(dataSectors[i] >= 0);
-	}*/
-	/*=====================linked-index===========================*/
-	if(fileSize<MaxFileSize)numBytes = fileSize;
-	else numBytes = MaxFileSize;
-	int remain_file_size = fileSize - numBytes;
-	numSectors = divRoundUp(numBytes,SectorSize);
+	}
+	for (i = 0; i < NumIndexTrees && remain > 0; i++) {
+		int *root = TreeRoot(i, &depth);
+		n = min(remain, TreeSpan(depth));
+		*root = AllocateTree(freeMap, depth, n);
+		remain -= n;
+	}
+	ASSERT(runWanted == 0 && runLength == 0);
+	return TRUE;
+}
 
-	if(freeMap->NumClear()<numSectors)return false;
+//----------------------------------------------------------------------
+// FileHeader::AllocateSparse
+// 	Initialize a fresh file header for a file of "fileSize" bytes that
+//	are all holes.  Nothing is taken from the free map, so this costs
+//	the same for any size; sectors are given out by Fill when the file
+//	is written.  Return FALSE if the file is too big for the index.
+//
+//	"fileSize" is the size of the file in bytes
+//----------------------------------------------------------------------
 
-	for(int i=0;i<numSectors;i++){
-		dataSectors[i] = freeMap->FindAndSet();
-		ASSERT(dataSectors[i] >= 0);
+bool FileHeader::AllocateSparse(int fileSize)
+{
+	numBytes = fileSize;
+	numSectors = divRoundUp(fileSize, SectorSize);
+	if (numSectors > MaxDataSectors)
+		return FALSE; // file too big for the index
+
+	memset(dataSectors, -1, sizeof(dataSectors));
+	singleIndirect = EmptySector;
+	doubleIndirect = EmptySector;
+	memset(tripleIndirect, -1, sizeof(tripleIndirect));
+	for (int i = 0; i < 3; i++)
+		cachedIndex[i] = EmptySector;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::NextSector
+//	Hand out the next sector of the extent being allocated, asking the
+//	free map for a new run when the current one is used up.  Each run
+//	asked for is as long as everything Allocate still needs, so a file
+//	only spans several extents when free space is fragmented.
+//----------------------------------------------------------------------
+
+int FileHeader::NextSector(PersistentBitmap *freeMap)
+{
+	if (runLength == 0) {
+		runStart = freeMap->FindAndSetRun(runWanted, &runLength);
+		// Allocate checked there was enough free space
+		ASSERT(runStart >= 0);
+		DEBUG(dbgFile, "Extent of " << runLength << " sectors at " << runStart);
 	}
-	if(remain_file_size>0){///need next hdf
-		next_hdf_sector = freeMap->FindAndSet();
-		if(next_hdf_sector==-1)return false;///not enough space
-		next_hdf = new FileHeader;
-		return next_hdf->Allocate(freeMap,remain_file_size);
+	runLength--;
+	runWanted--;
+	return runStart++;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateTree
+//	Allocate an index tree of "depth" levels pointing to "count" fresh
+//	data sectors, write its index blocks to disk, and return the
+//	sector of its root.  The caller has checked there is enough space.
+//----------------------------------------------------------------------
+
+int FileHeader::AllocateTree(PersistentBitmap *freeMap, int depth, int count)
+{
+	int table[NumIndirect];
+	int span = TreeSpan(depth - 1);
+	int sector = NextSector(freeMap); // index block sits just ahead of its data
+
+	for (int i = 0; i < NumIndirect; i++)
+		table[i] = EmptySector;
+	for (int i = 0; count > 0; i++) {
+		int n = min(count, span);
+		if (depth == 1)
+			table[i] = NextSector(freeMap);
+		else
+			table[i] = AllocateTree(freeMap, depth - 1, n);
+		ASSERT(table[i] >= 0);
+		count -= n;
 	}
-	return true;
+	kernel->blockCache->WriteSector(sector, (char *)table);
+	return sector;
 }
 
 //----------------------------------------------------------------------
-// FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// FileHeader::Fill
+// 	Make sure bytes "from" up to "to" of the file have sectors,
+//	allocating the data sectors and index blocks that are still
+//	holes, and grow the file to cover them if it is shorter.
+//	Return FALSE if there is not enough free space; then nothing
+//	changes.  The caller writes the header back.
+//
+//	Holes are counted before anything is allocated.  The index blocks
+//	a range needs are only bounded, not counted, so the extent asked
+//	for may be a few sectors too long; what is left of it is given
+//	back.  A write at the end of the file is rounded up to GrowSectors,
+//	so a file written a little at a time gets a few large extents
+//	rather than many small ones.
 //
 //	"freeMap" is the bit map of free disk sectors
+//	"from" is the offset of the first byte to be written
+//	"to" is the offset just past the last one
+//	"fresh", if not NULL, gets the index of each data sector given out,
+//		in order; those sectors still hold whatever was there before
 //----------------------------------------------------------------------
-///MP4 mod
-void FileHeader::Deallocate(PersistentBitmap *freeMap)
+
+bool FileHeader::Fill(PersistentBitmap *freeMap, int from, int to,
+					  List<int> *fresh)
 {
-	for (int i = 0; i < numSectors; i++) {
-      	ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-      	freeMap->Clear((int)dataSectors[i]);
-  	}
-  	if (next_hdf_sector != -1){
- 		ASSERT(next_hdf != NULL);
- 		next_hdf->Deallocate(freeMap);
-  	}
+	bool success;
+
+	lock->Acquire();
+	success = FillLocked(freeMap, from, to, fresh);
+	lock->Release();
+	return success;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillLocked
+// 	Fill, with the lock held.
+//----------------------------------------------------------------------
+
+bool FileHeader::FillLocked(PersistentBitmap *freeMap, int from, int to,
+							List<int> *fresh)
+{
+	int firstSector = divRoundDown(from, SectorSize);
+	int lastSector = divRoundDown(to - 1, SectorSize);
+	int holes = 0;
+	int index, bound, i;
+
+	if (lastSector >= MaxDataSectors)
+		return FALSE; // file too big for the index
+
+	for (index = firstSector; index <= lastSector; index++)
+		if (index >= numSectors || LookupSector(index) == EmptySector)
+			holes++;
+	if (holes > 0) {
+		if (lastSector >= numSectors - 1) {
+			// appending: take sectors up to a multiple of GrowSectors
+			int wanted = min(divRoundUp(lastSector + 1, GrowSectors) * GrowSectors,
+							 MaxDataSectors);
+			int extra = wanted - 1 - lastSector;
+			if (freeMap->NumClear() >= holes + extra + IndexSectors(wanted) -
+											IndexSectors(firstSector) + 3) {
+				holes += extra;
+				lastSector = wanted - 1;
+			}
+		}
+		// IndexSectors(firstSector) also counts the blocks holding sector
+		// firstSector - 1, at most one per level, which the range may share
+		bound = IndexSectors(lastSector + 1) - IndexSectors(firstSector) + 3;
+		if (freeMap->NumClear() < holes + bound)
+			return FALSE; // not enough space
+
+		// carry on from where the last Fill stopped, if that is still
+		// free, so a file filled a piece at a time stays in one extent
+		runWanted = holes + bound;
+		for (runLength = 0; runLength < runWanted && runStart >= 0 &&
+							runStart + runLength < freeMap->NumItems() &&
+							!freeMap->Test(runStart + runLength);
+			 runLength++)
+			freeMap->Mark(runStart + runLength);
+		for (index = firstSector; index <= lastSector; index++)
+			if (FillSlot(freeMap, index) && fresh != NULL)
+				fresh->Append(index);
+		for (i = 0; i < runLength; i++)
+			freeMap->Clear(runStart + i); // give back the unused end
+		runLength = 0;
+		runWanted = 0;
+		for (i = 0; i < 3; i++)
+			cachedIndex[i] = EmptySector; // index blocks have changed
+	}
+	numSectors = max(numSectors, lastSector + 1);
+	numBytes = max(numBytes, to);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillSlot
+//	Give data sector "index" of the file a sector, and any index blocks
+//	on the way to it, unless it already has one.  Return TRUE if it
+//	was a hole.
+//----------------------------------------------------------------------
+
+bool FileHeader::FillSlot(PersistentBitmap *freeMap, int index)
+{
+	int depth, span;
+
+	if (index < NumDirect) {
+		if (dataSectors[index] != EmptySector)
+			return FALSE;
+		dataSectors[index] = NextSector(freeMap);
+		return TRUE;
+	}
+	index -= NumDirect;
+	for (int tree = 0; tree < NumIndexTrees; tree++) {
+		int *root = TreeRoot(tree, &depth);
+		span = TreeSpan(depth);
+		if (index < span)
+			return ExtendTree(freeMap, root, depth, index);
+		index -= span;
+	}
+	ASSERTNOTREACHED();
+	return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendTree
+//	Add data sector "index" to the "depth" level index tree whose root
+//	is in "*root", allocating the index blocks on the way down if they
+//	are not there yet.  Index blocks come out of the extent before the
+//	data they map, as in AllocateTree.  A block is only written if it
+//	changed, so filling a sector that is already there costs nothing.
+//	Return TRUE if the data sector was a hole.
+//----------------------------------------------------------------------
+
+bool FileHeader::ExtendTree(PersistentBitmap *freeMap, int *root, int depth, int index)
+{
+	int table[NumIndirect];
+	int span = TreeSpan(depth - 1);
+	bool fresh = (*root == EmptySector);
+	bool added;
+	int *slot, old;
+
+	if (fresh) {
+		*root = NextSector(freeMap);
+		for (int i = 0; i < NumIndirect; i++)
+			table[i] = EmptySector;
+	} else {
+		kernel->blockCache->ReadSector(*root, (char *)table);
+	}
+
+	slot = &table[index / span];
+	old = *slot;
+	if (depth == 1) {
+		if (*slot == EmptySector)
+			*slot = NextSector(freeMap);
+		added = (*slot != old);
+	} else {
+		added = ExtendTree(freeMap, slot, depth - 1, index % span);
+	}
+	if (fresh || *slot != old)
+		kernel->blockCache->WriteSector(*root, (char *)table);
+	return added;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Punch
+// 	Turn data sectors "first" up to "last" of the file back into
+//	holes, freeing their sectors in the free map, along with every
+//	index block left with nothing below it.  The length of the file
+//	does not change.  The sectors are freed with Free, so they are not
+//	handed out again before the journal commits the change.  At most
+//	"budget" sectors are freed, so that a caller logging the free map
+//	knows how much one call can change; return the data sector to
+//	carry on from, which is "last" (or the end of the file) once the
+//	whole range is holes.  The caller writes the header back.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"first", "last" are the data sectors to punch, "last" excluded
+//	"budget" is the most sectors to free
+//----------------------------------------------------------------------
+
+int FileHeader::Punch(PersistentBitmap *freeMap, int first, int last, int budget)
+{
+	int base = NumDirect;
+	int end, next, done, depth, span, i;
+
+	ASSERT(budget >= 4); // room for a sector and the blocks above it
+	lock->Acquire();
+	end = min(last, numSectors);
+	next = end;
+	for (i = first; i < min(end, NumDirect); i++) {
+		if (dataSectors[i] == EmptySector)
+			continue; // a hole already
+		if (budget == 0) {
+			next = i;
+			break;
+		}
+		ASSERT(freeMap->Test(dataSectors[i])); // ought to be marked!
+		freeMap->Free(dataSectors[i]);
+		dataSectors[i] = EmptySector;
+		budget--;
+	}
+	for (i = 0; i < NumIndexTrees && next == end && base < end; i++) {
+		int *root = TreeRoot(i, &depth);
+		span = TreeSpan(depth);
+		int lo = max(first, base) - base;
+		int hi = min(end - base, span);
+		if (lo < hi && *root != EmptySector) {
+			done = PunchTree(freeMap, root, depth, lo, hi, &budget);
+			if (done < hi)
+				next = base + done;
+		}
+		base += span;
+	}
+	for (i = 0; i < 3; i++)
+		cachedIndex[i] = EmptySector; // index blocks have changed
+	lock->Release();
+	return (next == end) ? last : next;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::PunchTree
+//	Punch data sectors "first" up to "last" out of the "depth" level
+//	index tree whose root is in "*root", freeing at most "*budget"
+//	sectors.  If the root block is left empty, it is freed too and
+//	"*root" becomes a hole.  A data sector is only freed if the budget
+//	also covers the index blocks above it, so a block is never left
+//	empty without being freed.  Return the data sector of the tree to
+//	carry on from, or "last" if the range is done.
+//----------------------------------------------------------------------
+
+int FileHeader::PunchTree(PersistentBitmap *freeMap, int *root, int depth,
+						  int first, int last, int *budget)
+{
+	int table[NumIndirect];
+	int span = TreeSpan(depth - 1);
+	int next = last;
+	bool changed = FALSE;
+	int i, old, done;
+
+	kernel->blockCache->ReadSector(*root, (char *)table);
+	for (i = first / span; i * span < last; i++) {
+		if (table[i] == EmptySector)
+			continue; // a hole already
+		old = table[i];
+		if (depth == 1) {
+			if (*budget < 4) { // this sector, and up to three index blocks
+				next = i;
+				break;
+			}
+			ASSERT(freeMap->Test(table[i])); // ought to be marked!
+			freeMap->Free(table[i]);
+			table[i] = EmptySector;
+			(*budget)--;
+		} else {
+			int lo = max(first, i * span) - i * span;
+			int hi = min(last, (i + 1) * span) - i * span;
+			done = PunchTree(freeMap, &table[i], depth - 1, lo, hi, budget);
+			if (done < hi)
+				next = i * span + done;
+		}
+		changed = changed || (table[i] != old);
+		if (next != last)
+			break;
+	}
+
+	for (i = 0; i < NumIndirect && table[i] == EmptySector; i++)
+		;
+	if (i == NumIndirect) { // nothing left below it
+		ASSERT(freeMap->Test(*root));
+		freeMap->Free(*root);
+		*root = EmptySector;
+		(*budget)--;
+	} else if (changed) {
+		kernel->blockCache->WriteSector(*root, (char *)table);
+	}
+	return next;
+}
+
+//----------------------------------------------------------------------
+// ClaimSector
+//	Mark "sector" in "used" for the consistency checker.  Return 1 if
+//	it cannot belong to this file -- it is off the disk, or something
+//	else already claimed it -- and 0 otherwise.
+//----------------------------------------------------------------------
+
+static int
+ClaimSector(PersistentBitmap *used, int sector)
+{
+	if (sector < 0 || sector >= used->NumItems() || used->Test(sector))
+		return 1;
+	used->Mark(sector);
+	return 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Claim
+// 	Mark every sector this file uses, data and index blocks alike, in
+//	"used".  Used by the consistency checker, which builds "used" from
+//	every header it can reach; return the number of sectors that were
+//	off the disk or already claimed by another file.  Nothing below a
+//	bad index block is looked at; holes claim nothing.
+//
+//	"used" is the bit map of sectors found in use so far
+//----------------------------------------------------------------------
+
+int FileHeader::Claim(PersistentBitmap *used)
+{
+	int remain = numSectors;
+	int bad = 0;
+	int depth, n, i;
+
+	if (numSectors < 0 || numSectors > MaxDataSectors)
+		return 1; // not a file header
+	lock->Acquire();
+	for (i = 0; i < NumDirect && remain > 0; i++, remain--)
+		if (dataSectors[i] != EmptySector)
+			bad += ClaimSector(used, dataSectors[i]);
+	for (i = 0; i < NumIndexTrees && remain > 0; i++) {
+		int *root = TreeRoot(i, &depth);
+		n = min(remain, TreeSpan(depth));
+		bad += ClaimTree(used, *root, depth, n);
+		remain -= n;
+	}
+	lock->Release();
+	return bad;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ClaimTree
+//	Claim index block "root" and the "count" data sectors below it.
+//	The index blocks one level down are read as a batch, so a large
+//	file costs one sweep of the disk per level rather than a seek per
+//	index block.
+//----------------------------------------------------------------------
+
+int FileHeader::ClaimTree(PersistentBitmap *used, int root, int depth, int count)
+{
+	int table[NumIndirect];
+	int span = TreeSpan(depth - 1);
+	int bad = 0;
+
+	if (root == EmptySector)
+		return 0; // a hole
+	if (ClaimSector(used, root))
+		return 1;
+	kernel->blockCache->ReadSector(root, (char *)table);
+	if (depth > 1)
+		kernel->blockCache->ReadBatch(table, divRoundUp(count, span));
+	for (int i = 0; count > 0; i++) {
+		int n = min(count, span);
+		if (depth == 1) {
+			if (table[i] != EmptySector)
+				bad += ClaimSector(used, table[i]);
+		} else {
+			bad += ClaimTree(used, table[i], depth - 1, n);
+		}
+		count -= n;
+	}
+	return bad;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk.
+// 	Fetch contents of file header from disk.  Only the header sector
+//	is read; index blocks are fetched by ByteToSector when needed.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
 ///MP4
 void FileHeader::FetchFrom(int sector)
 {
-	kernel->synchDisk->ReadSector(sector, ((char *)this) + sizeof(FileHeader*));
+	int buf[NumIndirect];
+	int *p = buf;
 
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you will need to rebuild the header's structure
-	*/
+	kernel->blockCache->ReadSector(sector, (char *)buf);
+	numBytes = *p++;
+	numSectors = *p++;
+	memcpy(dataSectors, p, sizeof(dataSectors));
+	p += NumDirect;
+	singleIndirect = *p++;
+	doubleIndirect = *p++;
+	memcpy(tripleIndirect, p, sizeof(tripleIndirect));
 
-	if(next_hdf_sector!=-1){
-		next_hdf = new FileHeader;
-		next_hdf->FetchFrom(next_hdf_sector);
-	}
+	for (int i = 0; i < 3; i++)
+		cachedIndex[i] = EmptySector;
 }
 
 //----------------------------------------------------------------------
@@ -158,20 +665,58 @@ void FileHeader::FetchFrom(int sector)
 ///MP4 mod
 void FileHeader::WriteBack(int sector)
 {
-	kernel->synchDisk->WriteSector(sector, ((char *)this) + sizeof(FileHeader*));
+	int buf[NumIndirect];
+	int *p = buf;
+
+	lock->Acquire();
+	*p++ = numBytes;
+	*p++ = numSectors;
+	memcpy(p, dataSectors, sizeof(dataSectors));
+	p += NumDirect;
+	*p++ = singleIndirect;
+	*p++ = doubleIndirect;
+	memcpy(p, tripleIndirect, sizeof(tripleIndirect));
+	p += NumTripleIndirect;
+	ASSERT(p == buf + NumIndirect);	// the disk part fills exactly one sector
+	lock->Release();
+
+	kernel->blockCache->WriteSector(sector, (char *)buf);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FetchIndex
+//	Return the contents of index block "sector", which sits "level"
+//	levels above the data sectors.  The last block read on each level
+//	is kept in core, so sequential lookups hit the disk once per
+//	NumIndirect sectors at most.
+//----------------------------------------------------------------------
 
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you may not want to write all fields into disk.
-		Use this instead:
-		char buf[SectorSize];
-		memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-		...
-	*/
-	if(next_hdf_sector!=-1){
-		ASSERT(next_hdf != NULL);
-		next_hdf->WriteBack(next_hdf_sector);
+int *FileHeader::FetchIndex(int sector, int level)
+{
+	if (cachedIndex[level] != sector) {
+		kernel->blockCache->ReadSector(sector, (char *)indexTable[level]);
+		cachedIndex[level] = sector;
+	}
+	return indexTable[level];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LookupTree
+//	Walk a "depth" level index tree rooted at "root" down to data
+//	sector number "index" within the tree.
+//----------------------------------------------------------------------
+
+int FileHeader::LookupTree(int root, int depth, int index)
+{
+	int sector = root;
+
+	for (int level = depth - 1; level >= 0 && sector != EmptySector; level--) {
+		int span = TreeSpan(level);
+		int *table = FetchIndex(sector, level);
+		sector = table[index / span];
+		index %= span;
 	}
+	return sector;
 }
 
 //----------------------------------------------------------------------
@@ -179,21 +724,44 @@ void FileHeader::WriteBack(int sector)
 // 	Return which disk sector is storing a particular byte within the file.
 //      This is essentially a translation from a virtual address (the
 //	offset in the file) to a physical address (the sector where the
-//	data at the offset is stored).
+//	data at the offset is stored).  At most three index blocks are
+//	read, and usually none because of the in-core cache.
 //
 //	"offset" is the location within the file of the byte in question
 //----------------------------------------------------------------------
 ///MP4 mod
 int FileHeader::ByteToSector(int offset)
 {
-	int index = offset / SectorSize;
-  	if (index < NumDirect)
-  		 return (dataSectors[index]);
-  	else
-  	{
-  		 ASSERT(next_hdf != NULL);
-  		 return next_hdf->ByteToSector(offset - MaxFileSize);
-  	}
+	int sector;
+
+	lock->Acquire();
+	sector = LookupSector(offset / SectorSize);
+	lock->Release();
+	return sector;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LookupSector
+// 	Return the disk sector holding data sector "index" of the file,
+//	or EmptySector for a hole.  Called with the lock held.
+//----------------------------------------------------------------------
+
+int FileHeader::LookupSector(int index)
+{
+	int depth;
+
+	if (index < NumDirect)
+		return dataSectors[index];
+	index -= NumDirect;
+	for (int i = 0; i < NumIndexTrees; i++) {
+		int *root = TreeRoot(i, &depth);
+		int span = TreeSpan(depth);
+		if (index < span)
+			return LookupTree(*root, depth, index);
+		index -= span;
+	}
+	ASSERTNOTREACHED();
+	return EmptySector;
 }
 
 //----------------------------------------------------------------------
@@ -208,43 +776,22 @@ int FileHeader::FileLength()
 
 //----------------------------------------------------------------------
 // FileHeader::Print
-// 	Print the contents of the file header, and the contents of all
-//	the data blocks pointed to by the file header.
+// 	Print the contents of the file header, and the data sectors
+//	pointed to by the file header.  Holes show up as -1.
 //----------------------------------------------------------------------
 
 void FileHeader::Print()
 {
-    int i, j, k;
-    char *data = new char[SectorSize];
-
-    printf("FileHeader contents.  File size: %d.  File blocks:\n", cal_file_size());
-    cout<<"file header size: "<<numBytes<<"\n";
-    for (i = 0; i < numSectors; i++)
-    	printf("%d ", dataSectors[i]);
-    cout<<"\n\n";
-    /*printf("\nFile contents:\n");
-    for (i = k = 0; i < numSectors; i++) {
-	    kernel->synchDisk->ReadSector(dataSectors[i], data);
-      for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
-	    if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
-		    printf("%c", data[j]);
-      else
-		    printf("\\%x", (unsigned char)data[j]);
-	    }
-      printf("\n"); 
-    }*/
-
-	
-    delete [] data;
-}
-
-int FileHeader::cal_file_size(){
-	int result = 0;
-    FileHeader* next_hdf = this;
-    while (next_hdf != NULL)
-    {
-        result += next_hdf->FileLength();
-        next_hdf = next_hdf->get_next_hdf();
-    }
-    return result;
+	int i, depth;
+
+	printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
+	for (i = 0; i < numSectors; i++)
+		printf("%d ", ByteToSector(i * SectorSize));
+	printf("\nIndex roots: ");
+	for (i = 0; i < NumIndexTrees; i++) {
+		int *root = TreeRoot(i, &depth);
+		if (*root != EmptySector)
+			printf("%d(depth %d) ", *root, depth);
+	}
+	cout << "\n\n";
 }
@@ -16,20 +16,54 @@
 
 #include "disk.h"
 #include "pbitmap.h"
+#include "list.h"
 
-#define NumDirect ((SectorSize - 3 * sizeof(int)) / sizeof(int)) ///MP3 for bonus
-#define MaxFileSize (NumDirect * SectorSize)
+class Lock;
+
+///MP4 multi-level index
+#define NumIndirect ((int)(SectorSize / sizeof(int)))	// sector numbers in one index block
+#define NumTripleIndirect max(1, 2048 / SectorSize)
+				// a single triple-indirect tree only covers
+				// 4MB with 128-byte sectors, so keep enough
+				// roots to span a 64MB disk; with bigger
+				// sectors, one tree already covers 2GB
+#define NumDirect ((int)((SectorSize - (4 + NumTripleIndirect) * sizeof(int)) / sizeof(int)))
+#define IndexCapacity ((long long)NumDirect + NumIndirect + \
+			(long long)NumIndirect * NumIndirect + \
+			(long long)NumTripleIndirect * NumIndirect * NumIndirect * NumIndirect)
+				// sectors the index can map; may not fit
+				// in an int
+#define MaxDataSectors ((int)min(IndexCapacity, \
+			(long long)(0x7fffffff / SectorSize)))
+				// and a file's length, in bytes, is an int
+#define EmptySector (-1)	// marks an unused sector pointer
+#define GrowSectors 8		// a file grows by at least this many sectors
+				// at a time, so appends stay contiguous
 
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks.
+// The file header is organized as a table of pointers to data blocks,
+// like a UNIX i-node: the first NumDirect blocks are pointed to directly,
+// the next ones through a single-indirect block, then a double-indirect
+// tree, and finally NumTripleIndirect triple-indirect trees.
+//
+// Data is laid out in extents: Allocate asks the free map for the
+// smallest contiguous run that holds the whole file (index blocks
+// included, each placed just ahead of the data it maps), and only
+// splits the file over several runs when no single run is big enough.
+// The index still records every sector, so random access does not
+// depend on how many extents a file ended up in.
+//
+// Files may be sparse: an EmptySector pointer, for a data sector or
+// for a whole index block, is a hole that reads back as zeros.  Create
+// makes files that are all holes, and Fill gives sectors to a range
+// just before it is first written.  Punch turns sectors back into
+// holes; removing a file punches all of it.
 //
 // The file header data structure can be stored in memory or on disk.
-// When it is on disk, it is stored in a single sector -- this means
-// that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// When it is on disk, it is stored in a single sector.  Index blocks
+// are only read when a lookup needs them, so opening a file costs one
+// sector read no matter how big the file is.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
@@ -45,8 +79,20 @@ public:
 	bool Allocate(PersistentBitmap *bitMap, int fileSize); // Initialize a file header,
 														   //  including allocating space
 														   //  on disk for the file data
-	void Deallocate(PersistentBitmap *bitMap);			   // De-allocate this file's
-														   //  data blocks
+	bool AllocateSparse(int fileSize);					   // Initialize a file header
+														   //  for a file that is
+														   //  all holes
+	int Punch(PersistentBitmap *bitMap, int first, int last,
+			  int budget);								   // Free data sectors
+														   //  "first" to "last",
+														   //  a few at a time
+	bool Fill(PersistentBitmap *bitMap, int from, int to,
+			  List<int> *fresh = NULL);					   // Give bytes "from"
+														   //  to "to" sectors
+	int Claim(PersistentBitmap *used);					   // Mark this file's
+														   //  sectors in "used";
+														   //  return how many
+														   //  were bad
 
 	void FetchFrom(int sectorNumber); // Initialize file header from disk
 	void WriteBack(int sectorNumber); // Write modifications to file header
@@ -60,32 +106,51 @@ public:
 					  // in bytes
 
 	void Print(); // Print the contents of the file.
-	FileHeader* get_next_hdf(){
-		return next_hdf;
-	};////MP4 bonus1
-	int cal_file_size();///MP4 bonus2 pf
-	
+
 private:
 	/*
-		MP4 hint:
-		You will need a data structure to store more information in a header.
-		Fields in a class can be separated into disk part and in-core part.
-		Disk part are data that will be written into disk.
-		In-core part are data only lies in memory, and are used to maintain the data structure of this class.
-		In order to implement a data structure, you will need to add some "in-core" data
-		to maintain data structure.
-		
-		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
-		written to a sector on disk.
-		In-core part - none
-		
+		Disk part - numBytes, numSectors, dataSectors, singleIndirect,
+		doubleIndirect and tripleIndirect occupy exactly one sector.
+
+		In-core part - the most recently fetched index block on each
+		level of the tree, so sequential lookups do not re-read them,
+		and the extent Allocate is currently handing sectors out of.
+		Every OpenFile on a file shares one header, so a lock keeps a
+		lookup from seeing the index half way through a change.
 	*/
-	FileHeader* next_hdf;///MP4 mod
 	int numBytes;				// Number of bytes in the file
 	int numSectors;				// Number of data sectors in the file
 	int dataSectors[NumDirect]; // Disk sector numbers for each data
 								// block in the file
-	int next_hdf_sector;///MP4 mod
+	int singleIndirect;			// Index block of the next NumIndirect blocks
+	int doubleIndirect;			// Root of a two level index tree
+	int tripleIndirect[NumTripleIndirect]; // Roots of three level index trees
+
+	int cachedIndex[3];					// sector of the cached index block per level
+	int indexTable[3][NumIndirect];		// contents of those index blocks
+
+	int runStart;		// next free sector of the current extent;
+						// between Fills, where the next one tries
+						// to carry on
+	int runLength;		// sectors left in the current extent
+	int runWanted;		// sectors Allocate still has to hand out
+						// (Fill may ask for a few more than it uses)
+	Lock *lock;			// held by ByteToSector, Fill, Punch and the
+						// others that use the fields above
+
+	int NextSector(PersistentBitmap *freeMap); // Take a sector from the current extent
+	int *TreeRoot(int tree, int *depth);	// Root slot and depth of index tree "tree"
+	int *FetchIndex(int sector, int level);	// Read an index block, through the cache
+	int AllocateTree(PersistentBitmap *freeMap, int depth, int count);
+	bool FillSlot(PersistentBitmap *freeMap, int index);	// Give data sector "index" a sector
+	bool ExtendTree(PersistentBitmap *freeMap, int *root, int depth, int index);
+	int PunchTree(PersistentBitmap *freeMap, int *root, int depth,
+				  int first, int last, int *budget);
+	int ClaimTree(PersistentBitmap *used, int root, int depth, int count);
+	int LookupTree(int root, int depth, int index);
+	int LookupSector(int index);	// ByteToSector, with the lock held
+	bool FillLocked(PersistentBitmap *freeMap, int from, int to,
+					List<int> *fresh);
 };
 
 #endif // FILEHDR_H
@@ -21,23 +21,41 @@
 //	The file system assumes that the bitmap and directory files are
 //	kept "open" continuously while Nachos is running.
 //
+//	A superblock, after the journal, records the sector size and the
+//	number of sectors the file system was formatted for.  The bitmap
+//	is sized from it, and a disk that does not match it is not
+//	mounted.
+//
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
-//	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	are written back through the block cache, as one journal
+//	transaction (the two files are kept open during all this time).
+//	If the operation fails, and we have modified part of the
+//	directory, we simply discard the changed version, without writing
+//	it back; sectors it took from the bitmap are given back one by
+//	one, since other operations share the bitmap.
+//
+//	The bitmap stays in memory, shared by every operation.  It is
+//	only changed or written back with freeMapLock held, and each
+//	operation writes back its changes before it ends.  The lock is
+//	taken inside a journal operation, and before the lock of any file
+//	header.
+//
+//	Files grow when they are written past the end, and are sparse:
+//	a sector is only allocated when it is first written (see
+//	filehdr.h).  Directories can hold other directories, and names
+//	are full paths from the root (see directory.h).  Changes to the
+//	directories, file headers and bitmap are logged in a journal
+//	(see journal.h), so that a crash in the middle of an operation
+//	leaves the file system as it was before it or after it.
 //
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//	   Create, Remove and mkdir on one directory are not synchronized
+//	    with each other
+//	   files cannot be bigger than their index can map (see filehdr.h)
+//	   the data of a file is not journaled, so a crash can leave a
+//	    write half done, though never in another file's sectors
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -51,19 +69,91 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "blockcache.h"
+#include "synchdisk.h"
+#include "pathcache.h"
+#include "inodetable.h"
+#include "journal.h"
+#include "synch.h"
+#include "main.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known 
 // sectors, so that they can be located on boot-up.
 #define FreeMapSector 		0
 #define DirectorySector 	1
+#define SuperblockSector 	(JournalSector + JournalSectors)
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize 	(NumSectors / BitsInByte)
+#define SuperblockMagic 	0x4e465331	// "NFS1"
+
+// Initial file sizes for the bitmap and directory.  A directory file is
+// a header sector followed by its hash buckets; it starts with room for
+// NumDirEntries names and grows as names are added.
+#define FreeMapFileSize 	divRoundUp(numSectors, BitsInByte)
 #define NumDirEntries 		64	// MP4 
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+#define DirectoryFileSize 	((1 + divRoundUp(NumDirEntries, DirEntriesPerBucket)) * SectorSize)
+#define DirectorySectors	(DirectoryFileSize / SectorSize)
+
+// The most sectors each operation can log, which it reserves in the
+// journal when it begins.  Work that could change more sectors than a
+// commit holds -- filling a long write, freeing a file, growing a
+// directory, repairing the free map -- is done in steps, each its own
+// journal operation.
+#define DirOpBlocks 		(DirProbeLimit + 1)	// buckets and header changed
+							// by one Add or Remove
+#define CreateBlocks 		(DirOpBlocks + 2)	// and a new header, and its
+							// free map sector
+#define MkdirBlocks 		(CreateBlocks + 2 * DirectorySectors + 6)
+							// and the new directory, its
+							// index blocks, and their
+							// free map sectors
+#define FillStep 		16	// data sectors Fill hands out per step
+#define FillBlocks 		(FillStep + GrowSectors + 24)
+							// free map sectors of the
+							// data and index blocks taken,
+							// the index blocks changed,
+							// and the header
+#define PunchStep 		16	// sectors freed per step
+#define PunchBlocks 		(2 * PunchStep + 1)	// their free map sectors, the
+							// index blocks changed, and
+							// the header
+#define GrowStep 		32	// buckets of a grown directory
+							// written per step
+#define FixStep 		16	// free map sectors repaired
+							// per step
+
+//----------------------------------------------------------------------
+// CanonicalPath
+// 	Copy "name" into "path" in the form the path cache uses: every
+//	component preceded by a single '/', and "/" alone for the root.
+//	A name without a leading '/' is taken from the root as well.
+//	Return FALSE if a component or the whole path is too long.
+//----------------------------------------------------------------------
+
+static bool
+CanonicalPath(char *name, char *path)
+{
+    int len = 0, n;
+
+    while (*name != '\0') {
+        while (*name == '/')
+            name++;
+        for (n = 0; name[n] != '/' && name[n] != '\0'; n++)
+            ;
+        if (n == 0)
+            break;
+        if (n > FileNameMaxLen || len + 1 + n > PathNameMaxLen)
+            return FALSE;
+        path[len++] = '/';
+        strncpy(&path[len], name, n);
+        len += n;
+        name += n;
+    }
+    if (len == 0)
+        path[len++] = '/';
+    path[len] = '\0';
+    return TRUE;
+}
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -75,14 +165,29 @@
 //	If format = FALSE, we just have to open the files
 //	representing the bitmap and the directory.
 //
+//	Either way the bitmap stays in memory from then on; each
+//	operation writes back only the sectors of it that changed.
+//
+//	When mounting an existing disk, anything committed to the journal
+//	but not yet written home is replayed first.
+//
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
 
 FileSystem::FileSystem(bool format)
 { 
 	DEBUG(dbgFile, "Initializing the file system.");
+	// every operation must fit in what the journal lets one log
+	ASSERT(MkdirBlocks <= JournalOpBlocks && FillBlocks <= JournalOpBlocks);
+	ASSERT(PunchBlocks <= JournalOpBlocks && GrowStep <= JournalOpBlocks);
+	ASSERT(FixStep <= JournalOpBlocks);
+	pathCache = new PathCache;
+	freeMapLock = new Lock("free map");
+	journal = new Journal(kernel->blockCache->NumBlocks());
+	kernel->blockCache->SetJournal(journal);
 	if (format) {
-		PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
+		numSectors = kernel->synchDisk->NumSectors();
+		freeMap = new PersistentBitmap(numSectors);
 		Directory *directory = new Directory(NumDirEntries);
 		FileHeader *mapHdr = new FileHeader;
 		FileHeader *dirHdr = new FileHeader;
@@ -93,6 +198,9 @@ FileSystem::FileSystem(bool format)
 		// (make sure no one else grabs these!)
 		freeMap->Mark(FreeMapSector);	    
 		freeMap->Mark(DirectorySector);
+		journal->Format(freeMap);
+		freeMap->Mark(SuperblockSector);
+		WriteSuperblock();
 
 		// Second, allocate space for the data blocks containing the contents
 		// of the directory and bitmap files.  There better be enough space!
@@ -130,16 +238,58 @@ FileSystem::FileSystem(bool format)
 			freeMap->Print();
 			directory->Print();
 		}
-		delete freeMap; 
 		delete directory; 
 		delete mapHdr; 
 		delete dirHdr;
 	} else {
 		// if we are not formatting the disk, just open the files representing
 		// the bitmap and directory; these are left open while Nachos is running
+		journal->Recover();
+		ReadSuperblock();
 		freeMapFile = new OpenFile(FreeMapSector);
 		directoryFile = new OpenFile(DirectorySector);
+		freeMap = new PersistentBitmap(freeMapFile, numSectors);
 	}
+	journal->SetFreeMap(freeMap, freeMapLock);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteSuperblock
+// 	Record what the file system was formatted for: the sector size
+//	and the number of sectors.
+//----------------------------------------------------------------------
+
+void FileSystem::WriteSuperblock()
+{
+	int super[SectorSize / sizeof(int)];
+
+	memset(super, 0, sizeof(super));
+	super[0] = SuperblockMagic;
+	super[1] = SectorSize;
+	super[2] = numSectors;
+	kernel->blockCache->WriteSector(SuperblockSector, (char *)super);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReadSuperblock
+// 	Read the superblock when mounting, and check it matches this
+//	Nachos and this disk; the file system can't be used otherwise.
+//----------------------------------------------------------------------
+
+void FileSystem::ReadSuperblock()
+{
+	int super[SectorSize / sizeof(int)];
+
+	kernel->blockCache->ReadSector(SuperblockSector, (char *)super);
+	numSectors = super[2];
+	if (super[0] != SuperblockMagic || super[1] != SectorSize ||
+		numSectors != kernel->synchDisk->NumSectors()) {
+		cerr << "The disk does not hold a file system for "
+			 << kernel->synchDisk->NumSectors() << " " << SectorSize
+			 << "-byte sectors; format it with -f\n";
+	}
+	ASSERT(super[0] == SuperblockMagic && super[1] == SectorSize);
+	ASSERT(numSectors == kernel->synchDisk->NumSectors());
 }
 
 //----------------------------------------------------------------------
@@ -148,32 +298,42 @@ FileSystem::FileSystem(bool format)
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+	Sync();
+	kernel->blockCache->SetJournal(NULL);
+	delete journal;
+	delete freeMap;
+	delete freeMapLock;
 	delete freeMapFile;
 	delete directoryFile;
+	delete pathCache;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Create
 //  MP4 MODIFIED
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	The file starts out "initialSize" bytes long, all of it holes:
+//	no data blocks are allocated until the file is written, so a
+//	large file costs no more to create than a small one.
 //
 //	The steps to create a file are:
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
-// 	  Allocate space on disk for the data blocks for the file
-//	  Add the name to the directory
+// 	  Set up a header with no data blocks
+//	  Add the name to the directory (which may grow the directory)
 //	  Store the new file header on disk 
 //	  Flush the changes to the bitmap and the directory back to disk
 //
+//	If the directory is too full for the name, it is grown first, in
+//	steps of its own; the rest is one journal operation.
+//
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
 //   		file is already in directory
 //	 	no free space for file header
 //	 	no free entry for file in directory
-//	 	no free space for data blocks for the file 
+//	 	file too big for the index
 //
 // 	Note that this implementation assumes there is no concurrent access
 //	to the file system!
@@ -183,68 +343,67 @@ FileSystem::~FileSystem()
 //----------------------------------------------------------------------
 bool FileSystem::Create(char *name, int initialSize)
 {
-	if(!check_len(name))return false;
-    
+	char path[PathNameMaxLen + 1];
+	char *file_name;
 	Directory *directory;
 	OpenFile *directory_file;///MP4 mod 
-	PersistentBitmap *freeMap;
 	FileHeader *hdr;
-	int sector;
+	int sector, dir_sector;
 	bool success;
 
-	DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
+	if(!check_len(name) || !CanonicalPath(name, path))return false;
 
-	char* file_name = get_file_name(name);
-	char* dir_name = get_dir_name(name);
-	
-	// Default put in root
-	directory = new Directory(NumDirEntries);
-	directory_file = directoryFile;
+	DEBUG(dbgFile, "Creating file " << path << " size " << initialSize);
 
-	// 不放在root, 切到目標dir
-	if(dir_name!=NULL){
-		Directory* root_dir = new Directory(NumDirEntries);
-		root_dir->FetchFrom(directoryFile);
-
-		sector = root_dir->Find(dir_name, true);
-		if(sector == -1)return false; ///dir 不存在
-		
-		directory_file = new OpenFile(sector);	
-	}
+	dir_sector = WalkParent(path, &file_name);
+	if (dir_sector == -1)
+		return FALSE;	///dir 不存在
 
+	directory = new Directory(NumDirEntries);
+	directory_file = OpenDirectory(dir_sector);
 	directory->FetchFrom(directory_file);
-	
 
-	if (directory->Find(file_name, false) != -1){
+	if (directory->Find(file_name) != -1){
 		success = FALSE;			// file is already in directory
 	}
 	else {	///create!
-		freeMap = new PersistentBitmap(freeMapFile,NumSectors);
+		if (directory->Crowded(file_name))
+			(void)GrowDirectory(directory_file, directory); // without space,
+									// Add may still fit it
+		journal->Begin(CreateBlocks);
+		freeMapLock->Acquire();
 		sector = freeMap->FindAndSet();	// find a sector to hold the file header
+		freeMapLock->Release();
 		if (sector == -1) {
 			success = FALSE;		// no free block for file header 
 		}		
-		else if (!directory->Add(file_name, sector, FILE)){
-			success = FALSE;	// no space in directory
-		}
 		else {
 			hdr = new FileHeader;
-			if (!hdr->Allocate(freeMap, initialSize)){
-				success = FALSE;	// no space on disk for data
+			if (!hdr->AllocateSparse(initialSize)){
+				success = FALSE;	// too big for the index
+			}
+			else if (!directory->Add(file_name, sector, FILE)){
+				success = FALSE;	// no space in directory
 			}
 			else {	
 				success = TRUE;
 				// everthing worked, flush all changes back to disk
 				hdr->WriteBack(sector);
 				directory->WriteBack(directory_file);
-				freeMap->WriteBack(freeMapFile);
+				pathCache->Enter(path, sector, FILE);
 				DEBUG(dbgFile, "File Created Success");
 			}
 			delete hdr;
+			freeMapLock->Acquire();
+			if (!success)
+				freeMap->Clear(sector);	// give back the one sector taken
+			freeMap->WriteBack(freeMapFile);
+			freeMapLock->Release();
 		}
-		delete freeMap;
+		journal->End();
 	}
 	delete directory;
+	CloseDirectory(directory_file);
 	return success;
 }
 
@@ -259,29 +418,18 @@ bool FileSystem::Create(char *name, int initialSize)
 //----------------------------------------------------------------------
 
 OpenFile* FileSystem::Open(char *name){ 
-	
-	Directory *directory = new Directory(NumDirEntries);
+	char path[PathNameMaxLen + 1];
 	OpenFile *openFile = NULL;
-	int sector;
-
-	char* file_name = get_file_name(name);
-	char* dir_name = get_dir_name(name);
+	int sector, type;
 
 	DEBUG(dbgFile, "Opening file" << name);
-	
-	directory->FetchFrom(directoryFile);
-	if(dir_name != NULL){//如果不再root下，在更深的
-		sector = directory->Find(dir_name, true);
-		OpenFile *directory_file = new OpenFile(sector);
-		directory->FetchFrom(directory_file);
-		
-	}
 
-	sector = directory->Find(file_name, false); 
+	if (!CanonicalPath(name, path))
+		return NULL;
+	sector = Walk(path, &type);
 	if (sector >= 0){
 		openFile = new OpenFile(sector);	// name was found in directory 
 	}
-	delete directory;
 	return openFile;				// return NULL if not found
 }
 
@@ -294,6 +442,12 @@ OpenFile* FileSystem::Open(char *name){
 //	    Delete the space for its data blocks
 //	    Write changes to directory, bitmap back to disk
 //
+//	Taking the name out is one journal operation.  The file's sectors
+//	are freed after it, a few at a time, once no OpenFile is using
+//	them; a crash part way through leaves the rest marked in use,
+//	for Check to repair.  A directory removed with "rr_flag" is
+//	emptied first, one name at a time.
+//
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
 //	in the file system.
 //
@@ -302,134 +456,98 @@ OpenFile* FileSystem::Open(char *name){
 
 bool FileSystem::Remove(char *name, bool rr_flag)
 {
-	if(!check_len(name))return false;
+    char path[PathNameMaxLen + 1];
+    char *file_name;
     Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *fileHdr;
-    int sector;
+    OpenFile *directory_file;
+    int sector, dir_sector, type;
 
-    char* file_name = get_file_name(name);
-    char* dir_name = get_dir_name(name);
-    
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    OpenFile* delete_file = directoryFile;
+    if(!check_len(name) || !CanonicalPath(name, path))return false;
 
-    if(rr_flag){
-        freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-        sector = directory->Find(file_name,true);  
-        if (sector == -1){
-            delete directory;
-            return FALSE; // file not found
-        }
-        Directory* tmp_dir = new Directory(NumDirEntries);
-        OpenFile* tmp_dir_files = directoryFile;
-        tmp_dir->FetchFrom(directoryFile);
+    dir_sector = WalkParent(path, &file_name);
+    sector = Walk(path, &type);
+    if (dir_sector == -1 || sector == -1)
+        return FALSE; // file not found
+    if (type == DIR && !rr_flag)
+        return FALSE; // 要求只能刪除檔案, directories need -rr
 
-        if(dir_name!=NULL){////要刪除的不在root那一層，在更深的
-            delete_file = new OpenFile(directory->Find(dir_name,true));
-            directory->FetchFrom(tmp_dir_files);
-        }
-
-        delete_file = new OpenFile(sector);
-        directory->FetchFrom(delete_file);
-        //directory->List(0,true);
-        directory->remove_all_object(freeMap,delete_file);
-        
-
-        fileHdr = new FileHeader;
-        fileHdr->FetchFrom(sector);
-
-        fileHdr->Deallocate(freeMap); // remove data blocks
-        freeMap->Clear(sector);       // remove header block
-        
-        //cout<<"delete"<<file_name<<"\n";
-        //tmp_dir->List(0,true);
-
-        /*tmp_dir->FetchFrom(fi);
-        tmp_dir->List(0,true);*/
-        tmp_dir->Remove(file_name,false);
-
-        freeMap->WriteBack(freeMapFile);     // flush to disk
-        tmp_dir->WriteBack(tmp_dir_files); // flush to disk
-        //tmp_dir->List(0,true);
-
-
-        ////記得刪除目標dir
-        directory = new Directory(NumDirEntries);
-        directory->FetchFrom(directoryFile);
-        delete_file = directoryFile;
-        if(dir_name!=NULL){////要刪除的不在root那一層，在更深的
-            //cout<<"next want to delete not in root\n";
-            delete_file = new OpenFile(directory->Find(dir_name,true));
-            directory->FetchFrom(delete_file);
-        }
-        int fi = tmp_dir->Find(file_name,true);
-        //cout<<fi<<"\n";
-        sector = fi;
-        
-        freeMap->Clear(sector);       // remove header block
-        directory->Remove(file_name,false);
+    pathCache->Invalidate(path);
+    if (type == DIR)
+        Empty(sector); ////delete inside dir first
 
-        freeMap->WriteBack(freeMapFile);     // flush to disk
-        directory->WriteBack(delete_file); // flush to disk
+    directory = new Directory(NumDirEntries);
+    directory_file = OpenDirectory(dir_sector);
+    directory->FetchFrom(directory_file);
+    RemoveEntry(directory, directory_file, file_name, sector);
 
+    delete directory;
+    CloseDirectory(directory_file);
+    return TRUE;
+}
 
-    }
-    else{
-        //cout<<"just can delete a file\n";
-        if(dir_name!=NULL){////要刪除的不在root那一層，在更深的
-            //cout<<"want to delete not in root\n";
-            delete_file = new OpenFile(directory->Find(dir_name,true));
-            directory->FetchFrom(delete_file);
-        }
+//----------------------------------------------------------------------
+// FileSystem::RemoveEntry
+// 	Take "name", whose header is at "sector", out of "directory", as
+//	one journal operation, and write the directory back to "file".
+//	The file's sectors are freed once the last OpenFile on it is
+//	closed, which is here unless it is open.
+//----------------------------------------------------------------------
 
-        sector = directory->Find(file_name,false);  
-        if (sector == -1){
-            delete directory;
-            return FALSE; // file not found
-        }
-        fileHdr = new FileHeader;
-        fileHdr->FetchFrom(sector);
+void FileSystem::RemoveEntry(Directory *directory, OpenFile *file,
+                             char *name, int sector)
+{
+    journal->Begin(DirOpBlocks);
+    directory->Remove(name, false);
+    directory->WriteBack(file);
+    journal->End();
+
+    kernel->inodeTable->Acquire(sector);
+    kernel->inodeTable->Unlink(sector);
+    kernel->inodeTable->Release(sector); // frees it, if no one else has it
+}
 
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+//----------------------------------------------------------------------
+// FileSystem::Empty
+// 	Remove every name in the directory whose header is at "sector",
+//	and everything under the directories among them.
+//----------------------------------------------------------------------
 
-        fileHdr->Deallocate(freeMap); // remove data blocks
-        freeMap->Clear(sector);       // remove header block
-        bool valid = directory->Remove(file_name,true);
-        if(valid){ ///要求只能刪除檔案
-            freeMap->WriteBack(freeMapFile);     // flush to disk
-            directory->WriteBack(delete_file); // flush to disk
-        }
+void FileSystem::Empty(int sector)
+{
+    Directory *directory = new Directory(NumDirEntries);
+    OpenFile *directory_file = OpenDirectory(sector);
+    DirectoryEntry entry;
+
+    directory->FetchFrom(directory_file);
+    for (int i = 0; i < directory->NumSlots(); i++) {
+        entry = *directory->Entry(i);
+        if (!entry.inUse)
+            continue;
+        if (entry.type == DIR)
+            Empty(entry.sector);
+        RemoveEntry(directory, directory_file, entry.name, entry.sector);
     }
-
-    delete fileHdr;
     delete directory;
-    delete freeMap;
-    return TRUE;
+    CloseDirectory(directory_file);
 }
 
 ///MP4 mod
 void FileSystem::List(char *name, bool lr_flag)
 {
-	if(!check_len(name))return;
+    char path[PathNameMaxLen + 1];
+    int sector, type;
+
+    if(!check_len(name) || !CanonicalPath(name, path))return;
+    sector = Walk(path, &type);
+    if (sector == -1 || type != DIR)
+        return; ///沒找到
+
     Directory *directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    int path_len = strlen(name);
-    if(path_len<=1){
-        int depth = 0;
-        directory->List(depth,lr_flag);
-    }
-    else if(path_len>1){///not  root
-        char* target_dir = get_file_name(name); ///last is dir
-        int dir_file_sector = directory->Find(target_dir,true);
-        OpenFile* next_directory_files = new OpenFile(dir_file_sector);
-        Directory* next_directory = new Directory(NumDirEntries);
-        next_directory->FetchFrom(next_directory_files);
-        int depth = 0;
-        next_directory->List(0,lr_flag);
-    }
+    OpenFile *directory_file = OpenDirectory(sector);
+    directory->FetchFrom(directory_file);
+    directory->List(0,lr_flag);
     delete directory;
+    CloseDirectory(directory_file);
 }
 
 //----------------------------------------------------------------------
@@ -447,9 +565,9 @@ FileSystem::Print()
 {
 	FileHeader *bitHdr = new FileHeader;
 	FileHeader *dirHdr = new FileHeader;
-	PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile,NumSectors);
 	Directory *directory = new Directory(NumDirEntries);
 
+	printf("Superblock: %d sectors of %d bytes\n", numSectors, SectorSize);
 	printf("Bit map file header:\n");
 	bitHdr->FetchFrom(FreeMapSector);
 	bitHdr->Print();
@@ -465,62 +583,405 @@ FileSystem::Print()
 
 	delete bitHdr;
 	delete dirHdr;
-	delete freeMap;
 	delete directory;
 } 
 
-///MP4 mod
-void FileSystem::create_directory(char *name){
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Force every modified sector held in the block cache out to disk.
+//	Each operation already wrote its metadata, the free map and file
+//	headers included, into its journal transaction, so the journal
+//	only has to be committed before the cache is flushed.
+//----------------------------------------------------------------------
+
+void FileSystem::Sync()
+{
+	journal->Commit();
+	kernel->blockCache->Flush();
+}
 
-    if(!check_len(name))return;
+//----------------------------------------------------------------------
+// FileSystem::Fill
+// 	Give bytes "from" up to "to" of "file" sectors where they are still
+//	holes, taking them from the free map, and grow the file if it is
+//	shorter.  Called by OpenFile::WriteAt before writing.  The range
+//	is filled FillStep sectors at a time, each step a journal
+//	operation of its own.  Return how far the file has sectors from
+//	"from" on: "to", or less if the disk filled up.
+//
+//	"file" -- the open file to be written
+//	"from", "to" -- the bytes about to be written
+//	"fresh" -- if not NULL, gets the file sectors that were holes; the
+//		caller must write all of each one, as it holds stale data
+//----------------------------------------------------------------------
 
-    char* file_name = get_file_name(name);
-    char* dir_name = get_dir_name(name);
-    ///找free block，並初始化
-    PersistentBitmap* freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-    OpenFile* freeMapFile = new OpenFile(FreeMapSector);
+int FileSystem::Fill(OpenFile *file, int from, int to, ::List<int> *fresh)
+{
+	int step = FillStep * SectorSize;
+	int start, end;
+	bool success;
 
-    FileHeader* hdr = new FileHeader;
-    hdr->Allocate(freeMap, DirectoryFileSize);
+	while (from < to) {
+		start = from - from % step; // steps end on a multiple of
+		end = (to - start > step) ? start + step : to; // FillStep
+		journal->Begin(FillBlocks);
+		freeMapLock->Acquire();
+		success = file->Fill(freeMap, from, end, fresh);
+		if (success)
+			freeMap->WriteBack(freeMapFile);
+		freeMapLock->Release();
+		journal->End();
+		if (!success)
+			break;
+		from = end;
+	}
+	return from;
+}
 
-    Directory* directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+//----------------------------------------------------------------------
+// FileSystem::Punch
+// 	Turn data sectors "first" up to "last" of "file" back into holes,
+//	PunchStep sectors at a time, each step a journal operation.
+//----------------------------------------------------------------------
 
-    ///要創建的新資料夾
-    Directory* inside_directory = new Directory(NumDirEntries);
+void FileSystem::Punch(OpenFile *file, int first, int last)
+{
+	while (first < last) {
+		journal->Begin(PunchBlocks);
+		freeMapLock->Acquire();
+		first = file->Punch(freeMap, first, last, PunchStep);
+		freeMap->WriteBack(freeMapFile);
+		freeMapLock->Release();
+		journal->End();
+	}
+}
 
-    if(dir_name!=NULL){
-        int dir_file_sector = directory->Find(dir_name, true);
-        if(dir_file_sector==-1)return;///沒找到
-        Directory* current_directory = new Directory(NumDirEntries);
-        OpenFile* current_directory_files = new OpenFile(dir_file_sector);
-        current_directory->FetchFrom(current_directory_files);
+//----------------------------------------------------------------------
+// FileSystem::Reclaim
+// 	Free the header and data sectors of a file that was removed, now
+//	that the last OpenFile on it has been closed.  Called by the inode
+//	table.  The sectors are freed PunchStep at a time, each step a
+//	journal operation; the header is not written back, since no
+//	directory leads to it any more.
+//
+//	"sector" -- where the file's header is
+//	"hdr" -- the file's header
+//----------------------------------------------------------------------
 
-        int sector = freeMap->FindAndSet();
-        hdr->WriteBack(sector);
+void FileSystem::Reclaim(int sector, FileHeader *hdr)
+{
+	int next = 0;
+
+	while (next < MaxDataSectors) {
+		journal->Begin(PunchBlocks);
+		freeMapLock->Acquire();
+		next = hdr->Punch(freeMap, next, MaxDataSectors, PunchStep);
+		freeMap->WriteBack(freeMapFile);
+		freeMapLock->Release();
+		journal->End();
+	}
+	journal->Begin(1);
+	freeMapLock->Acquire();
+	freeMap->Free(sector);
+	freeMap->WriteBack(freeMapFile);
+	freeMapLock->Release();
+	journal->End();
+}
 
-        OpenFile* inside_directory_file = new OpenFile(sector);
-        inside_directory->WriteBack(inside_directory_file);
+//----------------------------------------------------------------------
+// FileSystem::GrowDirectory
+// 	Double the hash table of "directory", fetched from "file", as
+//	described in directory.cc: give the file sectors for the new table
+//	just after the old one, write the rehashed buckets there a few at
+//	a time, then the header, which switches to the new table, and last
+//	punch out the old table.  Each step is a journal operation of its
+//	own.  A crash before the header is written leaves the old table
+//	in use; one after it leaves the old table's sectors in the file,
+//	until the next time it grows.  Return FALSE, with the directory
+//	as it is on disk, if there is no space.
+//----------------------------------------------------------------------
+
+bool FileSystem::GrowDirectory(OpenFile *file, Directory *directory)
+{
+	int first, last;
+
+	if (!directory->Grow())
+		return FALSE;
+	first = directory->FirstBucket();
+	last = first + directory->NumBuckets();
+	if (Fill(file, first * SectorSize, last * SectorSize) < last * SectorSize) {
+		directory->FetchFrom(file); // back to the old table
+		return FALSE;
+	}
+
+	for (;;) {
+		journal->Begin(GrowStep);
+		int n = directory->WriteBuckets(GrowStep);
+		journal->End();
+		if (n == 0)
+			break;
+	}
+	journal->Begin(DirOpBlocks);
+	directory->WriteBack(file); // just the header: commit point
+	journal->End();
+
+	Punch(file, 1, first); // every table before this one
+	return TRUE;
+}
 
-        current_directory->Add(file_name, sector, DIR);
-        current_directory->WriteBack(current_directory_files);
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Check the file system for consistency, like UNIX fsck.  Starting
+//	from the root directory, claim the sectors of every file header
+//	that can be reached in a shadow bit map, then compare it with the
+//	free map:
+//	   leaked -- marked in use, but no file uses it
+//	   unmarked -- used by a file, but marked free, so it could be
+//		handed out a second time
+//	   bad -- a pointer off the disk, or a sector two files both use
+//
+//	Leaked and unmarked sectors are repaired, if "fix", by making the
+//	free map agree with the shadow map.  Bad sectors are only
+//	reported.  Return the number of problems found.
+//
+//	"fix" -- should the free map be repaired?
+//----------------------------------------------------------------------
+
+int FileSystem::Check(bool fix)
+{
+	PersistentBitmap *used = new PersistentBitmap(numSectors);
+	Directory *directory = new Directory(NumDirEntries);
+	FileHeader *hdr;
+	int bad = 0, leaked = 0, unmarked = 0;
+	int step = FixStep * SectorSize * BitsInByte;
+	int numNames, first, i;
+
+	journal->Commit(); // so no freed sector is still held back
+	used->Mark(FreeMapSector);
+	used->Mark(DirectorySector);
+	for (i = 0; i < JournalSectors; i++)
+		used->Mark(JournalSector + i);
+	used->Mark(SuperblockSector);
+
+	hdr = kernel->inodeTable->Acquire(FreeMapSector);
+	bad += hdr->Claim(used);
+	kernel->inodeTable->Release(FreeMapSector);
+	hdr = kernel->inodeTable->Acquire(DirectorySector);
+	bad += hdr->Claim(used);
+	kernel->inodeTable->Release(DirectorySector);
+
+	directory->FetchFrom(directoryFile);
+	numNames = directory->Check(used, &bad);
+	bad += kernel->inodeTable->ClaimUnlinked(used); // removed, still open
+
+	// the repairs go FixStep sectors of the free map per operation
+	for (first = 0; first < numSectors; first += step) {
+		if (fix)
+			journal->Begin(FixStep);
+		freeMapLock->Acquire();
+		for (i = first; i < numSectors && i < first + step; i++) {
+			if (used->Test(i) == freeMap->Test(i))
+				continue;
+			if (used->Test(i)) {
+				unmarked++;
+				if (fix)
+					freeMap->Mark(i);
+			} else {
+				leaked++;
+				if (fix)
+					freeMap->Clear(i);
+			}
+		}
+		if (fix)
+			freeMap->WriteBack(freeMapFile);
+		freeMapLock->Release();
+		if (fix)
+			journal->End();
+	}
+
+	printf("fsck: %d names, %d sectors in use, %d free\n",
+		   numNames, numSectors - used->NumClear(), used->NumClear());
+	printf("fsck: %d leaked, %d unmarked, %d bad sectors\n",
+		   leaked, unmarked, bad);
+	if (fix && leaked + unmarked > 0)
+		printf("fsck: free map repaired\n");
+
+	delete directory;
+	delete used;
+	return leaked + unmarked + bad;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::create_directory
+//	MP4 MODIFIED
+// 	Create an empty directory (similar to UNIX mkdir).  The steps are
+//	the same as for Create, except that the new file is initialized
+//	as an empty directory.  Nothing happens if the parent directory
+//	does not exist, or the name is already taken.
+//
+//	"name" -- path of the directory to be created
+//----------------------------------------------------------------------
+
+void FileSystem::create_directory(char *name){
+    char path[PathNameMaxLen + 1];
+    char *file_name;
+    int sector, dir_sector;
+
+    if(!check_len(name) || !CanonicalPath(name, path))return;
+
+    dir_sector = WalkParent(path, &file_name);
+    if (dir_sector == -1)
+        return; ///沒找到
+
+    Directory* directory = new Directory(NumDirEntries);
+    OpenFile* directory_file = OpenDirectory(dir_sector);
+    directory->FetchFrom(directory_file);
+    if (directory->Find(file_name) != -1) {
+        delete directory;
+        CloseDirectory(directory_file);
+        return;
     }
-    else{//放在root
-        int sector = freeMap->FindAndSet();
-		if(sector==-1)return;///沒找到
+    if (directory->Crowded(file_name))
+        (void)GrowDirectory(directory_file, directory);
+
+    ///找free block，並初始化
+    journal->Begin(MkdirBlocks);
+    FileHeader* hdr = new FileHeader;
+    bool success;
+
+    // the name goes in before the directory's sectors are taken, since
+    // Allocate either takes them all or none; so nothing but the header
+    // sector needs giving back
+    freeMapLock->Acquire();
+    sector = freeMap->FindAndSet();
+    success = sector != -1 && directory->Add(file_name, sector, DIR) &&
+              hdr->Allocate(freeMap, DirectoryFileSize);
+    if (!success && sector != -1)
+        freeMap->Clear(sector);
+    freeMap->WriteBack(freeMapFile);
+    freeMapLock->Release();
+
+    if (success) {
+        ///要創建的新資料夾
         hdr->WriteBack(sector);
+        Directory* inside_directory = new Directory(NumDirEntries);
         OpenFile* inside_directory_file = new OpenFile(sector);
         inside_directory->WriteBack(inside_directory_file);
-        directory->Add(file_name, sector, DIR);
-        directory->WriteBack(directoryFile);
+        delete inside_directory;
+        delete inside_directory_file;
+
+        directory->WriteBack(directory_file);
+        pathCache->Enter(path, sector, DIR);
     }
+    journal->End();
 
-    freeMap->WriteBack(freeMapFile);
-	delete directory;
-    delete inside_directory;
-    delete freeMapFile;
-	delete freeMap;
-	delete hdr;
+    delete directory;
+    CloseDirectory(directory_file);
+    delete hdr;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Walk
+// 	Return the sector of the file header of "path", and in "type"
+//	whether it is a FILE or a DIR; return -1 if there is no such file.
+//
+//	The path is looked up one component at a time from the root,
+//	fetching each directory on the way.  Every prefix found is put in
+//	the path cache, so the next lookup of the same path, or of a path
+//	sharing a prefix, skips those directories entirely.
+//
+//	"path" -- a path as built by CanonicalPath
+//----------------------------------------------------------------------
 
+int FileSystem::Walk(char *path, int *type)
+{
+    char prefix[PathNameMaxLen + 1];
+    char component[FileNameMaxLen + 1];
+    int sector = DirectorySector, next, n, len = 0;
+    char *p = path;
+
+    if (pathCache->Lookup(path, &sector, type))
+        return sector;
+
+    sector = DirectorySector;
+    *type = DIR;
+    while (*p == '/' && p[1] != '\0') {
+        if (*type != DIR)
+            return -1; // a file in the middle of the path
+        p++;
+        for (n = 0; p[n] != '/' && p[n] != '\0'; n++)
+            ;
+        strncpy(component, p, n);
+        component[n] = '\0';
+        prefix[len++] = '/';
+        strcpy(&prefix[len], component);
+        len += n;
+        p += n;
+
+        if (!pathCache->Lookup(prefix, &next, type)) {
+            Directory *directory = new Directory(NumDirEntries);
+            OpenFile *directory_file = OpenDirectory(sector);
+            directory->FetchFrom(directory_file);
+            next = directory->Find(component, type);
+            delete directory;
+            CloseDirectory(directory_file);
+            if (next == -1)
+                return -1; // not found
+            pathCache->Enter(prefix, next, *type);
+        }
+        sector = next;
+    }
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WalkParent
+// 	Return the header sector of the directory "path" would be in,
+//	and point "name" at the last component of "path"; return -1 if
+//	that directory does not exist, or "path" is the root.
+//
+//	"path" -- a path as built by CanonicalPath
+//----------------------------------------------------------------------
+
+int FileSystem::WalkParent(char *path, char **name)
+{
+    char parent[PathNameMaxLen + 1];
+    char *slash = strrchr(path, '/');
+    int sector, type;
+
+    *name = slash + 1;
+    if (**name == '\0')
+        return -1; // the root has no parent
+    if (slash == path) {
+        strcpy(parent, "/");
+    } else {
+        strncpy(parent, path, slash - path);
+        parent[slash - path] = '\0';
+    }
+    sector = Walk(parent, &type);
+    if (sector == -1 || type != DIR)
+        return -1;
+    return sector;
 }
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirectory/CloseDirectory
+// 	Open the directory file whose header is at "sector", and close it
+//	again.  The root directory is always kept open, and its OpenFile
+//	is shared, so that a root grown by Create is seen by everyone.
+//----------------------------------------------------------------------
+
+OpenFile *FileSystem::OpenDirectory(int sector)
+{
+    if (sector == DirectorySector)
+        return directoryFile;
+    return new OpenFile(sector);
+}
+
+void FileSystem::CloseDirectory(OpenFile *file)
+{
+    if (file != directoryFile)
+        delete file;
+}
+
 #endif // FILESYS_STUB
\ No newline at end of file
@@ -39,6 +39,13 @@
 
 typedef int OpenFileId;
 
+class PathCache;
+class PersistentBitmap;
+class Journal;
+class FileHeader;
+class Directory;
+class Lock;
+
 #ifdef FILESYS_STUB // Temporarily implement file system calls as
 // calls to UNIX, until the real file system
 // implementation is available
@@ -98,59 +105,26 @@ public:
 
 	void Print(); // List all the files and their contents
 
+	void Sync(); // Write all cached changes back to disk
 
+	int Fill(OpenFile *file, int from, int to,
+			 ::List<int> *fresh = NULL);	// Allocate the holes in
+											// an open file, for a
+											// write into them
+	void Reclaim(int sector, FileHeader *hdr); // Free a removed file
+											   // once it is closed
 
-	OpenFile* fileDescriptorTable[20];
-
-	int Close(int id){
-		int index = id-1;
-		if(index<0 || index>19)return 0; 
-		if(fileDescriptorTable[index]==NULL)return 0;
-		fileDescriptorTable[index] = 0;
-		return 1;
-	}
+	int Check(bool fix); // Check the free map against the files on
+						 // disk, repairing it if "fix" (fsck)
 
-	int Read(char *buf, int len, int id){
-		int index = id-1;
-		if(index<0 || index>19)return -1; 
-		if(fileDescriptorTable[index]==NULL)return -1;
-
-		return fileDescriptorTable[index]->Read(buf, len);
-	}
 
-	int Write(char *buf, int len, int id){
-		int index = id-1;
-		
-		if(index<0)return -1;
-		if(index>19)return -1; 
-		if(fileDescriptorTable[index]==NULL)return -1;
-
-		return fileDescriptorTable[index]->Write(buf, len);
-	}
 
 	char* get_file_name(char* name){
 		char* file_name = strrchr(name, '/');
+		if(file_name==NULL)return name;
 		file_name++;
 		return file_name;
 	}
-	char* get_dir_name(char* name){ ///MP4 
-		int name_len = strlen(name)+1;
-		char* tmp = new char[name_len];
-		memset(tmp,0,name_len);
-		memcpy(tmp, name, name_len);
-		char* file_name = get_file_name(name);
-		char* dir_name = strtok(name, "/");
-		char *ans = new char[255];
-		memset(ans,0,255);
-		while(dir_name != file_name){
-			memcpy(ans, dir_name, strlen(dir_name)+1);
-			dir_name = strtok(NULL, "/");
-		}
-		memcpy(name, tmp, name_len);
-		delete tmp;
-		if(strlen(ans)==0)return NULL;
-		return ans;
-	}
 	bool check_len(char* name){///MP4
 		char* file_name = get_file_name(name);
 		int file_len = strlen(file_name);
@@ -165,8 +139,33 @@ public:
 private:
 	OpenFile *freeMapFile;	 // Bit map of free disk blocks,
 							 // represented as a file
+	PersistentBitmap *freeMap; // In-core copy of the bit map, kept
+							   // for as long as Nachos is running
+	Lock *freeMapLock;		 // Held while changing freeMap, up to
+							 // writing it back
 	OpenFile *directoryFile; // "Root" directory -- list of
 							 // file names, represented as a file
+	PathCache *pathCache;	 // Paths looked up before, and the
+							 // sectors of their file headers
+	Journal *journal;		 // Log of metadata changes not yet
+							 // written home
+	int numSectors;			 // Size of the disk, from the superblock
+
+	int Walk(char *path, int *type);		   // Find the header of "path"
+	int WalkParent(char *path, char **name); // Find the directory "path"
+											   // would be in
+	bool GrowDirectory(OpenFile *file, Directory *directory);
+											   // Double its table
+	void RemoveEntry(Directory *directory, OpenFile *file,
+					 char *name, int sector);  // Remove one name
+	void Empty(int sector);					   // Remove everything in
+											   // a directory
+	void Punch(OpenFile *file, int first, int last); // Free sectors of
+											   // a file, in steps
+	OpenFile *OpenDirectory(int sector);	   // Open a directory file,
+	void CloseDirectory(OpenFile *file);	   // sharing the root's
+	void WriteSuperblock();					   // Record the disk's size
+	void ReadSuperblock();					   // Check it when mounting
 };
 
 #endif // FILESYS
@@ -0,0 +1,206 @@
+// inodetable.cc
+//	Routines to share file headers between the OpenFiles on a file.
+//
+//	A header is read from disk when the first OpenFile on it is
+//	created, and stays in memory until the last one is deleted.  The
+//	lock is held while a header is read or written, so a second thread
+//	opening the same file waits for the first rather than reading the
+//	header twice.
+//
+//	Removing a file that is open only marks its entry unlinked; the
+//	last Release gives its sectors back to the file system, so no
+//	OpenFile is ever left reading sectors another file now owns.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "inodetable.h"
+#include "filehdr.h"
+#include "pbitmap.h"
+#include "synch.h"
+#include "list.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// InodeKey, SectorHash
+// 	Functions the hash table needs: the key of an entry, and the
+//	hash of a key.
+//----------------------------------------------------------------------
+
+static int
+InodeKey(Inode *inode)
+{
+    return inode->sector;
+}
+
+static unsigned
+SectorHash(int sector)
+{
+    return (unsigned)sector;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize an empty table.
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable()
+{
+    table = new HashTable<int, Inode *>(InodeKey, SectorHash);
+    lock = new Lock("inode table");
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table, including the headers of files that are
+//	still open.
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    List<Inode *> *inodes = new List<Inode *>;
+    HashIterator<int, Inode *> *iter;
+
+    iter = new HashIterator<int, Inode *>(table);
+    for (; !iter->IsDone(); iter->Next())
+        inodes->Append(iter->Item());
+    delete iter;
+
+    while (!inodes->IsEmpty()) {
+        Inode *inode = inodes->RemoveFront();
+        table->Remove(inode->sector);
+        delete inode->hdr;
+        delete inode;
+    }
+    delete inodes;
+    delete lock;
+    delete table;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Find
+// 	Return the entry for the header at "sector"; it must be in use.
+//----------------------------------------------------------------------
+
+Inode *
+InodeTable::Find(int sector)
+{
+    Inode *inode;
+    bool found = table->Find(sector, &inode);
+
+    ASSERT(found);
+    return inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Acquire
+// 	Return the in-core header of the file whose header is at
+//	"sector", reading it from disk if no one has the file open.
+//	The caller must Release it when done.
+//
+//	"sector" -- the location on disk of the file header
+//----------------------------------------------------------------------
+
+FileHeader *
+InodeTable::Acquire(int sector)
+{
+    Inode *inode;
+
+    lock->Acquire();
+    if (table->Find(sector, &inode)) {
+        inode->refCount++;
+    } else {
+        inode = new Inode;
+        inode->sector = sector;
+        inode->hdr = new FileHeader;
+        inode->refCount = 1;
+        inode->unlinked = FALSE;
+        inode->hdr->FetchFrom(sector);
+        table->Insert(inode);
+    }
+    lock->Release();
+    return inode->hdr;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Release
+// 	Drop one reference to the header at "sector".  When the last one
+//	goes, free it; if the file was removed while it was open, its
+//	sectors are freed now too.
+//
+//	"sector" -- the location on disk of the file header
+//----------------------------------------------------------------------
+
+void
+InodeTable::Release(int sector)
+{
+    lock->Acquire();
+    Inode *inode = Find(sector);
+
+    ASSERT(inode->refCount > 0);
+    if (--inode->refCount > 0) {
+        lock->Release();
+        return;
+    }
+    table->Remove(sector);
+    lock->Release();
+
+    // outside the lock: freeing the file takes journal operations of
+    // its own, which may wait for others that need the table; so the
+    // caller must not be inside one
+    if (inode->unlinked)
+        kernel->fileSystem->Reclaim(sector, inode->hdr);
+    delete inode->hdr;
+    delete inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Unlink
+// 	The file whose header is at "sector" was removed from its
+//	directory; the caller holds a reference to it.  Its sectors are
+//	freed by the last Release, which may be the caller's, or may wait
+//	until every OpenFile on the file has been closed.
+//----------------------------------------------------------------------
+
+void
+InodeTable::Unlink(int sector)
+{
+    lock->Acquire();
+    Find(sector)->unlinked = TRUE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::ClaimUnlinked
+// 	For the consistency checker: mark in "used" the header and the
+//	sectors of every file that was removed while open, since no
+//	directory leads to them any more.  Return the number of sectors
+//	that were invalid or claimed twice.
+//----------------------------------------------------------------------
+
+int
+InodeTable::ClaimUnlinked(PersistentBitmap *used)
+{
+    HashIterator<int, Inode *> *iter;
+    int bad = 0;
+
+    lock->Acquire();
+    iter = new HashIterator<int, Inode *>(table);
+    for (; !iter->IsDone(); iter->Next()) {
+        Inode *inode = iter->Item();
+        if (!inode->unlinked)
+            continue;
+        if (used->Test(inode->sector)) {
+            bad++;
+            continue;
+        }
+        used->Mark(inode->sector);
+        bad += inode->hdr->Claim(used);
+    }
+    delete iter;
+    lock->Release();
+    return bad;
+}
@@ -0,0 +1,65 @@
+// inodetable.h
+//	Data structures for the table of file headers in memory.
+//
+//	Every OpenFile on the same file shares one in-core copy of the
+//	file header, so a change made through one (such as the file
+//	growing) is seen at once by all the others.  A change is written
+//	back by the operation that makes it, inside its journal
+//	transaction.  The table counts how many OpenFiles use each header,
+//	and frees it when the last one is closed.  A file removed while it
+//	is open keeps its sectors until then, as in UNIX.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef INODETABLE_H
+#define INODETABLE_H
+
+#include "hash.h"
+
+class FileHeader;
+class PersistentBitmap;
+class Lock;
+
+// The following class defines one file header in memory.
+
+class Inode
+{
+public:
+    int sector;      // Disk sector holding the header
+    FileHeader *hdr; // The header itself
+    int refCount;    // Number of OpenFiles using it
+    bool unlinked;   // Removed from its directory; free the file
+                     // on the last Release
+};
+
+// The following class defines the table of file headers in memory,
+// found through a hash table on the header sector.
+
+class InodeTable
+{
+public:
+    InodeTable();  // Initialize an empty table
+    ~InodeTable(); // De-allocate every header
+
+    FileHeader *Acquire(int sector); // Return the header at "sector",
+                                     // reading it in if needed
+    void Release(int sector);        // One less user of the header
+
+    void Unlink(int sector);    // The file was removed; free it on
+                                // the last Release
+    int ClaimUnlinked(PersistentBitmap *used); // Mark the sectors of
+                                // removed files that are still open
+
+private:
+    HashTable<int, Inode *> *table; // Headers by sector
+    Lock *lock;                     // Only one thread changes the
+                                    // table at a time
+
+    Inode *Find(int sector); // Return the entry for "sector"
+};
+
+#endif // INODETABLE_H
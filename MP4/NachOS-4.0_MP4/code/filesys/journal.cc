@@ -0,0 +1,336 @@
+// journal.cc
+//	Routines to log file system metadata before it is written home.
+//
+//	A commit goes in four steps:
+//	   1. write the logged sectors to the log region; the writes are
+//	      all queued at once, so the disk can do them in one sweep
+//	   2. write the header with the count of logged sectors; this is
+//	      the commit point.  The sector holding the count is written
+//	      last, so a header cut off half way still reads as empty
+//	   3. let the block cache write the sectors home, and hand out
+//	      again the sectors freed by the committed operations
+//	   4. write the header again with a count of zero
+//
+//	Recover repeats steps 3 and 4 for a log that got past step 2.
+//
+//	A disk with a write cache may put its writes on the surface in
+//	any order, so the cache is flushed after step 1, after step 2,
+//	and (with Sync) after step 3, each before the next step starts.
+//
+//	A logged sector is pinned in the block cache until its commit, so
+//	the cache must have room for the whole log; the log is therefore
+//	never allowed past half the cache, which is at least JournalOpBlocks
+//	sectors.  No operation runs during a commit, so a sector cannot
+//	change between being copied to the log and being written home;
+//	for the same reason the lock is not held while the commit does
+//	its I/O, and writes that are not part of an operation, such as
+//	file data, go on meanwhile.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "blockcache.h"
+#include "synchdisk.h"
+#include "pbitmap.h"
+#include "synch.h"
+#include "thread.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize an empty journal, for a block cache of "cacheBlocks"
+//	sectors, half of which it may pin.  The log on disk is not touched
+//	until Format or Recover.
+//----------------------------------------------------------------------
+
+Journal::Journal(int cacheBlocks)
+{
+    ASSERT(cacheBlocks >= MinCacheBlocks);
+    limit = min(JournalMaxBlocks, cacheBlocks / 2);
+    header[0] = 0;
+    reserved = 0;
+    committing = FALSE;
+    running = 0;
+    freeMap = NULL;
+    freeMapLock = NULL;
+    lock = new Lock("journal");
+    changed = new Condition("journal changed");
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  The caller commits first.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    ASSERT(running == 0 && header[0] == 0);
+    delete changed;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHeader
+// 	Write the journal header to disk, saying "count" sectors are
+//	logged.  The header is written straight to the disk, last sector
+//	first, so the count goes out after the list it describes.
+//----------------------------------------------------------------------
+
+void Journal::WriteHeader(int count)
+{
+    header[0] = count;
+    for (int i = JournalHeaderSectors - 1; i >= 0; i--)
+        kernel->synchDisk->WriteSector(JournalSector + i,
+                                       (char *)header + i * SectorSize);
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Reserve the sectors of the journal in "freeMap", and write an
+//	empty header.  Called when formatting the disk, before anything
+//	else is allocated.
+//----------------------------------------------------------------------
+
+void Journal::Format(PersistentBitmap *freeMap)
+{
+    for (int i = 0; i < JournalSectors; i++)
+        freeMap->Mark(JournalSector + i);
+    WriteHeader(0);
+}
+
+//----------------------------------------------------------------------
+// Journal::SetFreeMap
+// 	Tell the journal about the file system's free map, "map", and the
+//	lock "mapLock" that protects it.  Every commit settles the sectors
+//	freed in the map by the operations it commits.
+//----------------------------------------------------------------------
+
+void Journal::SetFreeMap(PersistentBitmap *map, Lock *mapLock)
+{
+    freeMap = map;
+    freeMapLock = mapLock;
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Called when mounting the disk, before any file is opened.  If a
+//	commit reached its commit point but was not finished, copy the
+//	logged sectors to where they belong.  A header that lists a
+//	sector off the disk, or inside the journal, was not written by a
+//	commit; nothing is replayed from it.
+//----------------------------------------------------------------------
+
+void Journal::Recover()
+{
+    char data[SectorSize];
+    int i;
+
+    for (i = 0; i < JournalHeaderSectors; i++)
+        kernel->synchDisk->ReadSector(JournalSector + i,
+                                      (char *)header + i * SectorSize);
+    if (header[0] <= 0 || header[0] > JournalMaxBlocks) {
+        header[0] = 0;
+        return;
+    }
+    for (i = 1; i <= header[0]; i++) {
+        if (header[i] < 0 || header[i] >= kernel->synchDisk->NumSectors() ||
+            (header[i] >= JournalSector &&
+             header[i] < JournalSector + JournalSectors)) {
+            DEBUG(dbgFile, "Journal header is garbage; nothing replayed");
+            WriteHeader(0);
+            return;
+        }
+    }
+
+    DEBUG(dbgFile, "Replaying " << header[0] << " sectors from the journal");
+    for (i = 0; i < header[0]; i++) {
+        kernel->synchDisk->ReadSector(JournalFirstBlock + i, data);
+        kernel->blockCache->WriteSector(header[i + 1], data);
+    }
+    kernel->blockCache->Flush();
+    kernel->synchDisk->Sync();
+    WriteHeader(0);
+}
+
+//----------------------------------------------------------------------
+// Journal::Current
+// 	Return the running operation of the current thread, or NULL if it
+//	is not inside one.  Only the thread itself sets it, so the lock is
+//	not needed.
+//----------------------------------------------------------------------
+
+Transaction *Journal::Current()
+{
+    return kernel->currentThread->transaction;
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start a file system operation, and reserve room in the log for
+//	the sectors it may change.  Wait if a commit is in progress, or if
+//	the log is too full; in that case, if no other operation is
+//	running, commit it first.  A thread already inside an operation
+//	just goes deeper into it.
+//
+//	"blocks" -- the most sectors the operation can log
+//----------------------------------------------------------------------
+
+void Journal::Begin(int blocks)
+{
+    Transaction *t;
+
+    ASSERT(blocks > 0 && blocks <= JournalOpBlocks);
+    t = Current();
+    if (t != NULL) {
+        t->depth++; // nested: the outer operation reserved for it
+        return;
+    }
+    lock->Acquire();
+    while (committing || header[0] + reserved + blocks > limit) {
+        if (!committing && running == 0)
+            CommitLocked();
+        else
+            changed->Wait(lock);
+    }
+    t = new Transaction;
+    t->depth = 1;
+    t->left = blocks;
+    reserved += blocks;
+    running++;
+    kernel->currentThread->transaction = t;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish a file system operation.  Its changes stay logged in
+//	memory until the group is committed; what it reserved and did
+//	not use is given back.
+//----------------------------------------------------------------------
+
+void Journal::End()
+{
+    Transaction *t = Current();
+
+    ASSERT(t != NULL);
+    if (--t->depth > 0)
+        return;
+    lock->Acquire();
+    reserved -= t->left;
+    running--;
+    kernel->currentThread->transaction = NULL;
+    delete t;
+    changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Log
+// 	Called by the block cache when "sector" changes.  If the current
+//	thread is inside an operation, add the sector to the log, out of
+//	what the operation reserved, and return TRUE; the block cache
+//	then pins it.  A sector changed twice is logged once.  Changes
+//	made outside any operation, such as file data, are not logged,
+//	and do not wait for the lock.
+//
+//	An operation that logs more than it reserved goes on into the room
+//	the log has past "limit" (the header holds JournalMaxBlocks), at
+//	the cost of pinning more of the cache; Nachos only stops if the
+//	header fills up.
+//----------------------------------------------------------------------
+
+bool Journal::Log(int sector)
+{
+    Transaction *t = Current();
+    int i;
+
+    if (t == NULL)
+        return FALSE;
+    lock->Acquire();
+    ASSERT(!committing);
+    for (i = 1; i <= header[0]; i++)
+        if (header[i] == sector)
+            break;
+    if (i > header[0]) {
+        if (t->left > 0) {
+            t->left--;
+            reserved--;
+        } else { // more than the operation said it would
+            DEBUG(dbgFile, "Operation logged more than it reserved");
+        }
+        ASSERT(header[0] < JournalMaxBlocks);
+        header[++header[0]] = sector;
+    }
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Wait for the running operations to end, then commit everything
+//	they logged.
+//----------------------------------------------------------------------
+
+void Journal::Commit()
+{
+    lock->Acquire();
+    while (running > 0 || committing)
+        changed->Wait(lock);
+    CommitLocked();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::CommitLocked
+// 	Commit the logged sectors, as described at the top of this file.
+//	Called with the lock held, when no operation is running.  The lock
+//	is let go during the I/O; "committing" keeps new operations out
+//	until the commit is done, so nothing else touches the header.
+//----------------------------------------------------------------------
+
+void Journal::CommitLocked()
+{
+    int count = header[0];
+    int i;
+
+    ASSERT(running == 0 && !committing);
+    if (count == 0)
+        return;
+    committing = TRUE;
+    lock->Release();
+    DEBUG(dbgFile, "Committing " << count << " sectors");
+
+    char *data = new char[count * SectorSize];
+    char **bufs = new char *[count];
+
+    for (i = 0; i < count; i++) {
+        kernel->blockCache->ReadSector(header[i + 1], data + i * SectorSize);
+        bufs[i] = data + i * SectorSize;
+    }
+    kernel->synchDisk->WaitFor( // the log is one run of sectors
+        kernel->synchDisk->WriteRequest(JournalFirstBlock, bufs, count));
+    kernel->synchDisk->Flush(); // the log is durable before the header
+    WriteHeader(count);         // commit point
+    kernel->synchDisk->Flush();
+
+    if (freeMap != NULL) { // the frees are committed now
+        freeMapLock->Acquire();
+        freeMap->Settle();
+        freeMapLock->Release();
+    }
+    for (i = 0; i < count; i++)
+        kernel->blockCache->Unpin(header[i + 1]);
+    kernel->blockCache->Flush();
+    kernel->synchDisk->Sync();
+    WriteHeader(0);
+
+    kernel->stats->numJournalCommits++;
+    delete[] bufs;
+    delete[] data;
+    lock->Acquire();
+    committing = FALSE;
+    changed->Broadcast(lock);
+}
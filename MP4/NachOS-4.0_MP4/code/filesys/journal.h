@@ -0,0 +1,114 @@
+// journal.h
+//	Data structures for the metadata journal (write-ahead log).
+//
+//	Every file system operation that changes the disk -- Create,
+//	Remove, making a directory -- runs as a transaction.  While one
+//	is running, the block cache does not write a changed sector back
+//	to its place on disk; it hands the sector to the journal instead.
+//	At commit, the journal writes all those sectors to a log region
+//	on disk, then a header listing where they belong, and only then
+//	lets the cache write them home.  If Nachos stops before the
+//	header is written, none of the changes reach the disk; if it
+//	stops after, the next mount copies them home from the log.
+//
+//	Several operations are committed together (group commit).  Each
+//	one says when it begins how many sectors it may log, and waits
+//	until the log has room for that many; if nothing else is running,
+//	the log is committed to make room.  A commit only happens between
+//	operations, never in the middle of one, so an operation is always
+//	committed whole.  Operations that could change more sectors than
+//	one commit holds are split into steps by the file system.
+//
+//	A sector an operation frees is not handed out again until the
+//	free is committed (see PersistentBitmap::Free).  Otherwise another
+//	file could write its data there, and a crash before the commit
+//	would bring back the old file, pointing at the new file's data.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+#include "utility.h"
+
+class Lock;
+class Condition;
+class PersistentBitmap;
+
+// The journal lives at a fixed place on disk, right after the headers
+// of the bitmap and root directory: a header holding the number of
+// logged sectors and where each belongs, then the logged sectors.
+
+#define JournalSector 2           // first sector of the journal header
+#define JournalMaxBlocks 127      // most sectors logged by one commit
+#define JournalHeaderSectors \
+    ((int)divRoundUp((JournalMaxBlocks + 1) * sizeof(int), SectorSize))
+#define JournalFirstBlock (JournalSector + JournalHeaderSectors)
+#define JournalSectors (JournalHeaderSectors + JournalMaxBlocks)
+#define JournalOpBlocks 64        // most sectors one operation may log;
+                                  // the log always has room for that
+
+// The following class defines one running operation.  The thread
+// running it points to it, so only changes made by that thread are
+// logged; a nested Begin by the same thread joins it.
+
+class Transaction
+{
+public:
+    int depth; // Begins not yet matched by an End
+    int left;  // Sectors it may still log
+};
+
+// The following class defines the journal.
+
+class Journal
+{
+public:
+    Journal(int cacheBlocks); // Initialize a journal in front of a
+                              // block cache of "cacheBlocks" sectors
+    ~Journal();               // De-allocate the journal
+
+    void Format(PersistentBitmap *freeMap); // Reserve the log on a new
+                                            // disk, and empty it
+    void SetFreeMap(PersistentBitmap *map, Lock *mapLock);
+                    // The free map whose freed sectors each commit
+                    // settles, and the lock that protects it
+    void Recover(); // Copy home anything committed but not installed
+
+    void Begin(int blocks); // Start a file system operation that
+                            // logs at most "blocks" sectors
+    void End();    // Finish one; its changes commit with the group
+    void Commit(); // Commit every finished operation now
+
+    bool Log(int sector); // Called by the block cache when "sector" is
+                          // changed; TRUE if the change is part of an
+                          // operation, and was logged
+
+private:
+    int header[JournalHeaderSectors * SectorSize / sizeof(int)];
+                     // Number of sectors logged, then where each
+                     // one belongs, padded to whole sectors
+    int limit;       // Most sectors to log before committing
+    int reserved;    // Sectors running operations may still log
+    bool committing; // Is a commit in progress?  No operation
+                     // runs while one is
+    int running;     // Operations started and not yet ended
+    Lock *lock;      // Protects the fields above; not held during
+                     // the I/O of a commit
+    Condition *changed; // Signalled when an operation ends, or a
+                        // commit finishes
+    PersistentBitmap *freeMap; // The file system's free map
+    Lock *freeMapLock;         // and its lock
+
+    Transaction *Current();     // The operation of the current
+                                // thread, or NULL
+    void CommitLocked();        // Commit, called with the lock held
+    void WriteHeader(int count); // Write the header with "count" sectors
+};
+
+#endif // JOURNAL_H
@@ -5,7 +5,9 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  All the OpenFiles on one file
+//	share a single copy of the header, kept in the kernel's inode
+//	table.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -16,31 +18,37 @@
 #include "main.h"
 #include "filehdr.h"
 #include "openfile.h"
-#include "synchdisk.h"
+#include "blockcache.h"
+#include "inodetable.h"
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open, unless another OpenFile on
+//	the same file already did.
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 {
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    hdr = kernel->inodeTable->Acquire(sector);
+    hdrSector = sector;
     seekPosition = 0;
+    lastReadEnd = 0;
+    readAheadWindow = 0;
+    readAheadNext = 0;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	The in-core header goes away with the last OpenFile on the file.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    kernel->inodeTable->Release(hdrSector);
 }
 
 //----------------------------------------------------------------------
@@ -83,24 +91,34 @@ int OpenFile::Write(char *into, int numBytes)
     return result;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::ReadV/WriteV
+// 	Like Read/Write, but the bytes come from, or go to, "count" buffers
+//	one after the other, moved as a single request.
+//----------------------------------------------------------------------
+
+int OpenFile::ReadV(IoSpan *spans, int count)
+{
+    int result = ReadAtV(spans, count, seekPosition);
+    seekPosition += result;
+    return result;
+}
+
+int OpenFile::WriteV(IoSpan *spans, int count)
+{
+    int result = WriteAtV(spans, count, seekPosition);
+    seekPosition += result;
+    return result;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::ReadAt/WriteAt
 // 	Read/write a portion of a file, starting at "position".
 //	Return the number of bytes actually written or read, but has
 //	no side effects (except that Write modifies the file, of course).
 //
-//	There is no guarantee the request starts or ends on an even disk sector
-//	boundary; however the disk only knows how to read/write a whole disk
-//	sector at a time.  Thus:
-//
-//	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
-//	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	A single buffer is just a request of one span; see ReadAtV and
+//	WriteAtV.
 //
 //	"into" -- the buffer to contain the data to be read from disk
 //	"from" -- the buffer containing the data to be written to disk
@@ -111,11 +129,114 @@ int OpenFile::Write(char *into, int numBytes)
 
 int OpenFile::ReadAt(char *into, int numBytes, int position)
 {
-    //int fileLength = hdr->FileLength();
-    int fileLength = Length();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
+    IoSpan span = {into, numBytes};
+    return ReadAtV(&span, 1, position);
+}
+
+int OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    IoSpan span = {from, numBytes};
+    return WriteAtV(&span, 1, position);
+}
+
+//----------------------------------------------------------------------
+// SpanRun
+//	If the next "n" bytes of "spans", from byte "*at" of span "*k" on,
+//	are all in one span, return where they are and move past them.
+//	Otherwise return NULL and leave the position alone.
+//----------------------------------------------------------------------
 
+static char *
+SpanRun(IoSpan *spans, int count, int *k, int *at, int n)
+{
+    while (*k < count && *at == spans[*k].len) {
+        (*k)++; // skip finished and empty spans
+        *at = 0;
+    }
+    if (*k == count || spans[*k].len - *at < n)
+        return NULL;
+    *at += n;
+    return &spans[*k].buf[*at - n];
+}
+
+//----------------------------------------------------------------------
+// SpanCopy
+//	Copy "n" bytes between "data" and "spans", starting at byte "*at"
+//	of span "*k", and move past them.  "toSpans" says which way.
+//----------------------------------------------------------------------
+
+static void
+SpanCopy(IoSpan *spans, int count, int *k, int *at, char *data, int n,
+         bool toSpans)
+{
+    while (n > 0) {
+        ASSERT(*k < count);
+        int m = min(n, spans[*k].len - *at);
+        if (toSpans)
+            bcopy(data, &spans[*k].buf[*at], m);
+        else
+            bcopy(&spans[*k].buf[*at], data, m);
+        data += m;
+        n -= m;
+        *at += m;
+        if (*at == spans[*k].len) {
+            (*k)++;
+            *at = 0;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAtV/WriteAtV
+// 	Read/write the bytes of "count" buffers, one after the other, at
+//	"position" in the file, as one request: the file is walked once,
+//	and grown or filled in once, whatever the number of buffers.
+//	Return the number of bytes actually read or written.
+//
+//	There is no guarantee the request starts or ends on an even disk sector
+//	boundary, or that a buffer does; however the disk only knows how to
+//	read/write a whole disk sector at a time.  A whole sector that lies
+//	in a single buffer is moved straight between the block cache and
+//	that buffer, with no copy in between.  Thus:
+//
+//	For ReadAtV:
+//	   Any other sector is read into a one-sector buffer, and we copy
+//	   the part we are interested in out to the buffers it spans.
+//	For WriteAtV:
+//	   We must first read in a sector that will be partially written,
+//	   so that we don't overwrite the unmodified portion.  We then copy
+//	   in the data that will be modified, and write the sector back.
+//	   Sectors that are still holes, and any past the end of the file,
+//	   are allocated first; a gap between the old end and "position"
+//	   reads back as zeros.  If the disk is full, the write stops at
+//	   the first sector that has no room.
+//
+//	Holes are not read: ReadAtV returns zeros for them without any I/O.
+//
+//	"spans" -- the buffers, and how many bytes each holds
+//	"count" -- the number of buffers
+//	"position" -- the offset within the file of the first byte to be
+//			read/written
+//
+//	When the request covers more than one sector, ReadAtV has the
+//	block cache load them a batch at a time (see LoadBatch), so that
+//	runs of consecutive sectors come off the disk as single requests.
+//	A batch is a quarter of the cache, so it is used before it can be
+//	evicted.  ReadAtV also starts read-ahead of the sectors after the
+//	request, when the request continues where the last one ended.
+//----------------------------------------------------------------------
+
+int OpenFile::ReadAtV(IoSpan *spans, int count, int position)
+{
+    int fileLength = hdr->FileLength();
+    int i, firstSector, lastSector, numBytes = 0;
+    int k = 0, at = 0;
+    int batch = max(kernel->blockCache->NumBlocks() / 4, 1);
+    char buf[SectorSize];
+    char *to;
+
+    for (i = 0; i < count; i++)
+        numBytes += spans[i].len;
     if ((numBytes <= 0) || (position >= fileLength))
         return 0; // check request
     if ((position + numBytes) > fileLength)
@@ -124,61 +245,181 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                                      &buf[(i - firstSector) * SectorSize]);
+    for (i = firstSector; i <= lastSector; i++) {
+        if (lastSector > firstSector && (i - firstSector) % batch == 0)
+            LoadBatch(i, min(lastSector, i + batch - 1));
+
+        int start = max(position, i * SectorSize);
+        int end = min(position + numBytes, (i + 1) * SectorSize);
+        int sector = hdr->ByteToSector(i * SectorSize);
 
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete[] buf;
+        if (sector == EmptySector) { // a hole
+            memset(buf, 0, SectorSize);
+        } else if (end - start == SectorSize &&
+                   (to = SpanRun(spans, count, &k, &at, SectorSize)) != NULL) {
+            kernel->blockCache->ReadSector(sector, to);
+            continue;
+        } else {
+            kernel->blockCache->ReadSector(sector, buf);
+        }
+        SpanCopy(spans, count, &k, &at, &buf[start - i * SectorSize],
+                 end - start, TRUE);
+    }
+    ReadAhead(position, lastSector);
+    lastReadEnd = position + numBytes;
     return numBytes;
 }
 
-int OpenFile::WriteAt(char *from, int numBytes, int position)
+int OpenFile::WriteAtV(IoSpan *spans, int count, int position)
 {
-    //int fileLength = hdr->FileLength();
-    int fileLength = Length();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int fileLength = hdr->FileLength();
+    int i, firstSector, lastSector, backed, numBytes = 0;
+    int k = 0, at = 0;
+    char buf[SectorSize];
+    char *data;
+    List<int> fresh; // sectors Fill just gave out, in order
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    for (i = 0; i < count; i++)
+        numBytes += spans[i].len;
+    if (numBytes <= 0)
         return 0; // check request
-    if ((position + numBytes) > fileLength)
-        numBytes = fileLength - position;
+
+    // find how much of the request already has sectors
+    backed = min(position + numBytes, fileLength);
+    for (i = divRoundDown(position, SectorSize); i * SectorSize < backed; i++)
+        if (hdr->ByteToSector(i * SectorSize) == EmptySector) {
+            backed = max(i * SectorSize, position);
+            break;
+        }
+    if (backed < position + numBytes) {
+        int filled = kernel->fileSystem->Fill(this, position, position + numBytes, &fresh);
+        if (filled > position) {
+            if (position > fileLength)
+                ZeroFill(fileLength, position);
+            fileLength = hdr->FileLength();
+        }
+        backed = max(backed, filled);
+        if (backed <= position)
+            return 0; // no room
+        numBytes = min(numBytes, backed - position);
+    }
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    buf = new char[numSectors * SectorSize];
+    // (partly written sectors are read straight from the cache, so they
+    // do not look like a ReadAt to read-ahead; ones that were holes are
+    // not read at all, since what is on disk there is not the file's)
+    for (i = firstSector; i <= lastSector; i++) {
+        int start = max(position, i * SectorSize);
+        int end = min(position + numBytes, (i + 1) * SectorSize);
+        int sector = hdr->ByteToSector(i * SectorSize);
+        bool wasHole = FALSE;
+
+        while (!fresh.IsEmpty() && fresh.Front() <= i)
+            wasHole = (fresh.RemoveFront() == i);
+        if (end - start == SectorSize &&
+            (data = SpanRun(spans, count, &k, &at, SectorSize)) != NULL) {
+            kernel->blockCache->WriteSector(sector, data);
+            continue;
+        }
+        if (wasHole)
+            memset(buf, 0, SectorSize);
+        else if (end - start < SectorSize)
+            kernel->blockCache->ReadSector(sector, buf);
+        SpanCopy(spans, count, &k, &at, &buf[start - i * SectorSize],
+                 end - start, FALSE);
+        kernel->blockCache->WriteSector(sector, buf);
+    }
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ZeroFill
+// 	Write zeros over bytes "from" up to "to" of the file, the gap left
+//	by a write that started past the end of the file at "from".  Holes
+//	already read as zeros; the only sectors past the end of a file are
+//	the ones Fill took when rounding up to GrowSectors, so
+//	the rest of the gap is not even looked at.
+//----------------------------------------------------------------------
+
+void OpenFile::ZeroFill(int from, int to)
+{
+    char buf[SectorSize];
 
-    memset(buf, 0, sizeof(char) * numSectors * SectorSize); // dummy operation to keep valgrind happy
+    to = min(to, divRoundUp(divRoundUp(from, SectorSize), GrowSectors) *
+                     GrowSectors * SectorSize);
+    while (from < to) {
+        int sector = hdr->ByteToSector(from);
+        int offset = from % SectorSize;
+        int n = min(to - from, SectorSize - offset);
+        if (sector != EmptySector) {
+            if (n < SectorSize)
+                kernel->blockCache->ReadSector(sector, buf);
+            memset(&buf[offset], 0, n);
+            kernel->blockCache->WriteSector(sector, buf);
+        }
+        from += n;
+    }
+}
 
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
+//----------------------------------------------------------------------
+// OpenFile::LoadBatch
+// 	Bring file sectors "first" through "last" into the block cache
+//	together, skipping holes.
+//----------------------------------------------------------------------
 
-    // read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize],
-               SectorSize, lastSector * SectorSize);
+void OpenFile::LoadBatch(int first, int last)
+{
+    int *sectors = new int[last - first + 1];
+    int n = 0;
 
-    // copy in the bytes we want to change
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+    for (int i = first; i <= last; i++)
+        if ((sectors[n] = hdr->ByteToSector(i * SectorSize)) != EmptySector)
+            n++;
+    kernel->blockCache->ReadBatch(sectors, n);
+    delete[] sectors;
+}
 
-    // write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                                       &buf[(i - firstSector) * SectorSize]);
-    delete[] buf;
-    return numBytes;
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called by ReadAt after reading up to "lastSector".  If the read
+//	started at "position" == lastReadEnd, the file is being scanned, so
+//	ask the block cache to load the sectors that come next without
+//	waiting for them.  The window doubles on each sequential read, up
+//	to MaxReadAhead sectors; any other read resets it.
+//
+//	Sectors already requested are not requested again, so a reader
+//	going a few bytes at a time only queues each sector once.
+//
+//	"position" -- the offset of the first byte just read
+//	"lastSector" -- the last file sector just read
+//----------------------------------------------------------------------
+
+void OpenFile::ReadAhead(int position, int lastSector)
+{
+    int fileSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    int i, last;
+
+    if (position != lastReadEnd) {
+        readAheadWindow = 0; // random access, don't guess
+        readAheadNext = lastSector + 1;
+        return;
+    }
+    if (readAheadWindow == 0)
+        readAheadWindow = 2;
+    else if (readAheadWindow < MaxReadAhead)
+        readAheadWindow = min(2 * readAheadWindow, MaxReadAhead);
+
+    last = min(lastSector + readAheadWindow, fileSectors - 1);
+    for (i = max(readAheadNext, lastSector + 1); i <= last; i++) {
+        int sector = hdr->ByteToSector(i * SectorSize);
+        if (sector != EmptySector) // holes are never read
+            kernel->blockCache->ReadAhead(sector);
+    }
+    readAheadNext = max(readAheadNext, last + 1);
 }
 
 //----------------------------------------------------------------------
@@ -188,17 +429,49 @@ int OpenFile::WriteAt(char *from, int numBytes, int position)
 
 int OpenFile::Length()
 {
-    //return hdr->FileLength();
+    return hdr->FileLength();
+}
 
-    ///link list traversal
-    int file_size = 0;
-    FileHeader* next_hdf = hdr;
-    while (next_hdf != NULL)
-    {
-        file_size += next_hdf->FileLength();
-        next_hdf = next_hdf->get_next_hdf();
-    }
-    return file_size;
+//----------------------------------------------------------------------
+// OpenFile::Fill
+// 	Give bytes "from" up to "to" of the file sectors where they are
+//	holes, growing the file if it ends before "to".  The new header is
+//	written back at once, so it goes into the caller's journal
+//	transaction along with the index blocks and the free map.  Return
+//	FALSE if there is not enough free space on disk.
+//
+//	"freeMap" -- the bit map to take sectors from; the caller writes
+//		it back
+//	"from", "to" -- the bytes about to be written
+//	"fresh" -- if not NULL, gets the file sectors that were holes
+//----------------------------------------------------------------------
+
+bool OpenFile::Fill(PersistentBitmap *freeMap, int from, int to,
+                    List<int> *fresh)
+{
+    if (!hdr->Fill(freeMap, from, to, fresh))
+        return FALSE;
+    hdr->WriteBack(hdrSector);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Punch
+// 	Turn data sectors "first" up to "last" of the file back into
+//	holes, freeing at most "budget" sectors, and write the new header
+//	back.  Return the data sector to carry on from; see
+//	FileHeader::Punch.
+//
+//	"freeMap" -- the bit map to give sectors to; the caller writes
+//		it back
+//----------------------------------------------------------------------
+
+int OpenFile::Punch(PersistentBitmap *freeMap, int first, int last, int budget)
+{
+    int next = hdr->Punch(freeMap, first, last, budget);
+
+    hdr->WriteBack(hdrSector);
+    return next;
 }
 
 #endif //FILESYS_STUB
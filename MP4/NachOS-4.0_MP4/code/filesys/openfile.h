@@ -23,6 +23,16 @@
 #include "copyright.h"
 #include "utility.h"
 #include "sysdep.h"
+#include "list.h"
+
+// One piece of a scattered buffer, for the vectored reads and writes.
+// A request made of several spans is still one transfer on the file.
+
+struct IoSpan
+{
+	char *buf; // where the piece is in memory
+	int len;   // how many bytes it holds
+};
 
 #ifdef FILESYS_STUB // Temporarily implement calls to
 					// Nachos file system as calls to UNIX!
@@ -74,6 +84,9 @@ private:
 
 #else // FILESYS
 class FileHeader;
+class PersistentBitmap;
+
+#define MaxReadAhead 16 // most sectors requested ahead of a sequential reader
 
 class OpenFile
 {
@@ -96,14 +109,48 @@ public:
 	// bypassing the implicit position.
 	int WriteAt(char *from, int numBytes, int position);
 
+	int ReadV(IoSpan *spans, int count);  // Read/write the bytes of
+	int WriteV(IoSpan *spans, int count); // several buffers as one
+										  // request, at the implicit
+										  // position
+	int ReadAtV(IoSpan *spans, int count, int position);
+	int WriteAtV(IoSpan *spans, int count, int position);
+	// ... or bypassing it
+
 	int Length(); // Return the number of bytes in the
 				  // file (this interface is simpler
 				  // than the UNIX idiom -- lseek to
 				  // end of file, tell, lseek back
 
+	int HeaderSector() { return hdrSector; } // Where the file's header
+											 // is, to open it again
+
+	bool Fill(PersistentBitmap *freeMap, int from, int to,
+			  List<int> *fresh);							// Allocate the holes
+															// in a range about
+															// to be written
+	int Punch(PersistentBitmap *freeMap, int first, int last,
+			  int budget);									// Free some of the
+															// sectors in a range
+
 private:
 	FileHeader *hdr;  // Header for this file
+	int hdrSector;	  // Disk sector holding the header
 	int seekPosition; // Current position within the file
+
+	int lastReadEnd;	 // Byte after the last ReadAt; a read starting
+						 // here continues a sequential scan
+	int readAheadWindow; // Sectors to keep requested past the reader
+	int readAheadNext;	 // First sector not yet requested
+
+	void ReadAhead(int position, int lastSector); // Request the sectors
+												  // a sequential reader
+												  // will want next
+	void LoadBatch(int first, int last);		  // Load file sectors
+												  // "first".."last"
+												  // into the cache
+	void ZeroFill(int from, int to);			  // Clear a gap left by
+												  // writing past the end
 };
 
 #endif // FILESYS
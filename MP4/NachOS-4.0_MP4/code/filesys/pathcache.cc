@@ -0,0 +1,159 @@
+// pathcache.cc
+//	Routines to manage the cache of path name lookups.
+//
+//	The hash table from lib/hash.h compares keys with "==", so the key
+//	is a hash of the path string, and the path itself is kept in the
+//	entry.  Two paths with the same hash cannot both be cached; the
+//	newer one replaces the older.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "pathcache.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// PathHash
+// 	Hash a path string (FNV-1a).
+//----------------------------------------------------------------------
+
+static unsigned
+PathHash(char *path)
+{
+    unsigned h = 2166136261u;
+
+    for (; *path != '\0'; path++) {
+        h ^= (unsigned char)*path;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//----------------------------------------------------------------------
+// EntryKey, KeyHash
+// 	Functions the hash table needs: the key of an entry, and the
+//	hash of a key, which is already well mixed.
+//----------------------------------------------------------------------
+
+static unsigned
+EntryKey(PathEntry *entry)
+{
+    return entry->key;
+}
+
+static unsigned
+KeyHash(unsigned key)
+{
+    return key;
+}
+
+//----------------------------------------------------------------------
+// PathCache::PathCache
+// 	Initialize an empty path cache.
+//----------------------------------------------------------------------
+
+PathCache::PathCache()
+{
+    table = new HashTable<unsigned, PathEntry *>(EntryKey, KeyHash);
+    order = new List<PathEntry *>;
+}
+
+//----------------------------------------------------------------------
+// PathCache::~PathCache
+// 	De-allocate the cache and every entry in it.
+//----------------------------------------------------------------------
+
+PathCache::~PathCache()
+{
+    while (!order->IsEmpty())
+        Drop(order->Front());
+    delete order;
+    delete table;
+}
+
+//----------------------------------------------------------------------
+// PathCache::Drop
+// 	Remove "entry" from the cache and de-allocate it.
+//----------------------------------------------------------------------
+
+void PathCache::Drop(PathEntry *entry)
+{
+    table->Remove(entry->key);
+    order->Remove(entry);
+    delete entry;
+}
+
+//----------------------------------------------------------------------
+// PathCache::Lookup
+// 	Return TRUE, and the header sector and type of "path", if the
+//	path is cached.
+//
+//	"path" -- a full path, as built by FileSystem::Walk
+//	"sector", "type" -- where to return the result
+//----------------------------------------------------------------------
+
+bool PathCache::Lookup(char *path, int *sector, int *type)
+{
+    PathEntry *entry;
+
+    if (!table->Find(PathHash(path), &entry) || strcmp(entry->path, path))
+        return FALSE;
+    *sector = entry->sector;
+    *type = entry->type;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// PathCache::Enter
+// 	Remember that "path" has its header at "sector".  If the cache is
+//	full, the oldest entry makes room.
+//
+//	"path" -- a full path, as built by FileSystem::Walk
+//	"sector" -- the sector of its file header
+//	"type" -- FILE or DIR
+//----------------------------------------------------------------------
+
+void PathCache::Enter(char *path, int sector, int type)
+{
+    unsigned key = PathHash(path);
+    PathEntry *entry;
+
+    ASSERT(strlen(path) <= PathNameMaxLen);
+    if (table->Find(key, &entry))
+        Drop(entry); // same path, or one that collides with it
+    if (order->NumInList() >= PathCacheSize)
+        Drop(order->Front());
+
+    entry = new PathEntry;
+    entry->key = key;
+    strcpy(entry->path, path);
+    entry->sector = sector;
+    entry->type = type;
+    table->Insert(entry);
+    order->Append(entry);
+}
+
+//----------------------------------------------------------------------
+// PathCache::Invalidate
+// 	Forget "path", and every path that goes through it, since a
+//	removed directory takes everything in it along.
+//
+//	"path" -- a full path, as built by FileSystem::Walk
+//----------------------------------------------------------------------
+
+void PathCache::Invalidate(char *path)
+{
+    int len = strlen(path);
+    List<PathEntry *> stale;
+    ListIterator<PathEntry *> iter(order);
+
+    for (; !iter.IsDone(); iter.Next()) {
+        char *p = iter.Item()->path;
+        if (!strncmp(p, path, len) && (p[len] == '\0' || p[len] == '/'))
+            stale.Append(iter.Item());
+    }
+    while (!stale.IsEmpty())
+        Drop(stale.RemoveFront());
+}
@@ -0,0 +1,58 @@
+// pathcache.h
+//	Data structures for a cache of path name lookups, so that opening
+//	a file by a path seen before does not walk the directories again.
+//
+//	The cache maps a full path, such as "/a/b/c", to the sector of its
+//	file header and whether it is a file or a directory.  Only names
+//	that exist are cached; the file system removes an entry, and
+//	everything under it, when the name goes away.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include "list.h"
+#include "hash.h"
+
+#define PathNameMaxLen 255   // same limit FileSystem::check_len enforces
+#define PathCacheSize 1024   // most paths remembered at once
+
+// The following class defines one cached lookup.
+
+class PathEntry
+{
+public:
+    unsigned key;                  // Hash of the path
+    char path[PathNameMaxLen + 1]; // The path, so hash collisions
+                                   // can be told apart
+    int sector;                    // Sector of the file header
+    int type;                      // FILE or DIR
+};
+
+// The following class defines the path cache.  Entries are found
+// through a hash table on the path; when the cache is full, the oldest
+// entry is dropped.
+
+class PathCache
+{
+public:
+    PathCache();  // Initialize an empty cache
+    ~PathCache(); // De-allocate the cache
+
+    bool Lookup(char *path, int *sector, int *type); // Is "path" cached?
+    void Enter(char *path, int sector, int type);    // Remember a lookup
+    void Invalidate(char *path); // Forget "path" and every path under it
+
+private:
+    HashTable<unsigned, PathEntry *> *table; // Entries by path hash
+    List<PathEntry *> *order;                // Entries, oldest first
+
+    void Drop(PathEntry *entry); // Take an entry out of the cache
+};
+
+#endif // PATHCACHE_H
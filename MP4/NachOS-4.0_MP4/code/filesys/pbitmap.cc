@@ -2,12 +2,21 @@
 //	Routines to manage a persistent bitmap -- a bitmap that is
 //	stored on disk.
 //
+//	Each sector of the bitmap file has a dirty flag, set whenever a
+//	bit in that sector changes.  Allocating a few sectors then costs
+//	a write of one or two sectors of the map, rather than the whole
+//	map.
+//
+//	Bits that were freed but not settled are kept in a second array,
+//	"held", and masked out of "map" as it is written back.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "disk.h"
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -16,11 +25,19 @@
 //
 //	"numItems" is the number of bits in the bitmap.
 //
-//      This constructor does not initialize the bitmap from a disk file
+//      This constructor does not initialize the bitmap from a disk file,
+//      so every sector counts as changed: the first WriteBack writes
+//      the whole bitmap.
 //----------------------------------------------------------------------
 
 PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 {
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+    for (int i = 0; i < numSectors; i++)
+        dirty[i] = TRUE;
+    held = new unsigned int[numWords];
+    memset(held, 0, numWords * sizeof(unsigned));
 }
 
 //----------------------------------------------------------------------
@@ -37,10 +54,14 @@ PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 
 PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numItems)
 {
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+    held = new unsigned int[numWords];
+
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    FetchFrom(file);
 }
 
 //----------------------------------------------------------------------
@@ -50,11 +71,25 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numIte
 
 PersistentBitmap::~PersistentBitmap()
 {
+    delete[] dirty;
+    delete[] held;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::WordChanged
+// 	Called by Mark and Clear when word "w" of the map changes; the
+//	sector of the file that holds it must be written back.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::WordChanged(int w)
+{
+    dirty[w * sizeof(unsigned) / SectorSize] = TRUE;
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::FetchFrom
-// 	Initialize the contents of a persistent bitmap from a Nachos file.
+// 	Initialize the contents of a persistent bitmap from a Nachos file;
+//	afterwards nothing is changed.
 //
 //	"file" is the place to read the bitmap from
 //----------------------------------------------------------------------
@@ -62,16 +97,66 @@ PersistentBitmap::~PersistentBitmap()
 void PersistentBitmap::FetchFrom(OpenFile *file)
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    for (int i = 0; i < numSectors; i++)
+        dirty[i] = FALSE;
+    memset(held, 0, numWords * sizeof(unsigned));
+    Recount();
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
-// 	Store the contents of a persistent bitmap to a Nachos file.
+// 	Store the changed sectors of a persistent bitmap to a Nachos file.
+//	Bits that are held are written as clear.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
 
 void PersistentBitmap::WriteBack(OpenFile *file)
 {
-    file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int numBytes = numWords * sizeof(unsigned);
+    unsigned int words[SectorSize / sizeof(unsigned)];
+
+    for (int i = 0; i < numSectors; i++) {
+        if (dirty[i]) {
+            int offset = i * SectorSize;
+            int first = offset / sizeof(unsigned);
+            int n = min(SectorSize, numBytes - offset);
+            for (int w = 0; w < n / (int)sizeof(unsigned); w++)
+                words[w] = map[first + w] & ~held[first + w];
+            dirty[i] = FALSE; // before the write, which may wait
+            file->WriteAt((char *)words, n, offset);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Free
+// 	Free the "nth" bit as far as the disk is concerned: the next
+//	WriteBack writes it as clear.  It stays set in memory, so it is
+//	not handed out again, until Settle.
+//
+//	"which" is the number of the bit to be freed.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Free(int which)
+{
+    ASSERT(Test(which));
+    held[which / BitsInWord] |= 1u << (which % BitsInWord);
+    WordChanged(which / BitsInWord);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Settle
+// 	Clear in memory every bit freed since the last Settle.  Called
+//	once what WriteBack wrote for them can no longer be undone.  The
+//	sectors of the file do not change, so none is marked as changed.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Settle()
+{
+    for (int w = 0; w < numWords; w++) {
+        map[w] &= ~held[w];
+        held[w] = 0;
+    }
+    Recount();
 }
@@ -6,6 +6,14 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    The bitmap remembers which sectors of its file have changed
+//    since it was read or written, and WriteBack writes only those.
+//
+//    A bit can also be freed without being handed out again at once:
+//    Free clears it in what WriteBack writes, but leaves it set in
+//    memory until Settle.  The file system frees sectors this way, so
+//    a sector is not reused before the journal commits its free.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -30,7 +38,22 @@ public:
     ~PersistentBitmap(); // deallocate bitmap
 
     void FetchFrom(OpenFile *file); // read bitmap from the disk
-    void WriteBack(OpenFile *file); // write bitmap contents to disk
+    void WriteBack(OpenFile *file); // write changed sectors to disk
+
+    void Free(int which); // Clear the "nth" bit on disk, but keep it
+                          // set in memory until Settle
+    void Settle();        // The bits freed so far are clear on disk
+                          // for good; clear them in memory too
+
+protected:
+    void WordChanged(int w); // Note the sector holding word "w"
+                             // needs writing back
+
+private:
+    int numSectors; // Number of sectors the bitmap fills
+    bool *dirty;    // Which of them changed
+    unsigned int *held; // Bits freed but not settled: set in "map",
+                        // written back as clear
 };
 
 #endif // PBITMAP_H
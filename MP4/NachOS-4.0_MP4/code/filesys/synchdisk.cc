@@ -5,10 +5,15 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Because the physical disk can only handle one operation at a
+//	time, requests that arrive while it is busy are queued, and the
+//	interrupt handler starts the next one.  Each request has its own
+//	semaphore, which the interrupt handler signals when it completes.
+//	With several disks (RAID-0 or RAID-1), each has its own queue,
+//	and a request is split into pieces for the disks it involves.
+//
+//	The queues are shared with the interrupt handler, so they are
+//	protected by turning interrupts off rather than by a lock.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -16,19 +21,237 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// RequestCompare
+// 	Order disk requests by sector number, for the pending queue.
+//----------------------------------------------------------------------
+
+static int
+RequestCompare(DiskRequest *x, DiskRequest *y)
+{
+    if (x->sector < y->sector)
+        return -1;
+    else if (x->sector > y->sector)
+        return 1;
+    else
+        return 0;
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to read or write one disk sector.
+//
+//	"sectorNumber" -- the disk sector to read/write
+//	"buf" -- where the data comes from or goes to
+//	"write" -- TRUE for a write, FALSE for a read
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int sectorNumber, char *buf, bool write)
+{
+    sector = sectorNumber;
+    count = 1;
+    one = buf;
+    data = &one;
+    writing = write;
+    done = new Semaphore("disk request", 0);
+    parent = NULL;
+    pieces = 0;
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to read or write "n" consecutive sectors.
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"bufs" -- bufs[i] is where the data for sector sectorNumber + i
+//		comes from or goes to
+//	"n" -- the number of sectors
+//	"write" -- TRUE for a write, FALSE for a read
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int sectorNumber, char **bufs, int n, bool write)
+{
+    ASSERT(n > 0);
+    sector = sectorNumber;
+    count = n;
+    data = new char *[n];
+    for (int i = 0; i < n; i++)
+        data[i] = bufs[i];
+    writing = write;
+    done = new Semaphore("disk request", 0);
+    parent = NULL;
+    pieces = 0;
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to flush the disk's write cache.  It is
+//	queued as if for sector -1, so C-LOOK takes it at the end of the
+//	sweep the head is on.
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest()
+{
+    sector = -1;
+    count = 0;
+    data = NULL;
+    writing = TRUE;
+    done = new Semaphore("disk flush", 0);
+    parent = NULL;
+    pieces = 0;
+}
+
+DiskRequest::~DiskRequest()
+{
+    if (data != &one)
+        delete[] data; // NULL for a flush
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// Finished
+// 	Called by the interrupt handler when a request is done.  Wake up
+//	the thread waiting for it; a piece of a request is not waited
+//	for, but is de-allocated, and wakes up the thread waiting for the
+//	whole request, if it was the last piece.
+//----------------------------------------------------------------------
+
+static void
+Finished(DiskRequest *request)
+{
+    DiskRequest *parent = request->parent;
+
+    if (parent == NULL) {
+        request->done->V();
+        return;
+    }
+    delete request;
+    parent->pieces--;
+    if (parent->pieces == 0)
+        parent->done->V();
+}
+
+//----------------------------------------------------------------------
+// DiskUnit::DiskUnit
+// 	Initialize one disk of the set, and its queue.
+//
+//	"unit" -- which disk of the set this is
+//	"sectorsPerTrack", "numTracks" -- the geometry to format the disk
+//		with, or 0 to use the disk as it is
+//----------------------------------------------------------------------
+
+DiskUnit::DiskUnit(int unit, int sectorsPerTrack, int numTracks)
+{
+    pending = new SortedList<DiskRequest *>(RequestCompare);
+    current = NULL;
+    disk = new Disk(this, sectorsPerTrack, numTracks, unit);
+}
+
+DiskUnit::~DiskUnit()
+{
+    delete disk;
+    delete pending;
+}
+
+//----------------------------------------------------------------------
+// DiskUnit::Queue
+// 	Put a request on the queue, and start the disk if it is idle.
+//	Called with interrupts off.
+//----------------------------------------------------------------------
+
+void DiskUnit::Queue(DiskRequest *request)
+{
+    pending->Insert(request);
+    if (current == NULL)
+        Dispatch();
+}
+
+//----------------------------------------------------------------------
+// DiskUnit::Outstanding
+// 	Return how many requests this disk has to do before it could
+//	start on a new one.
+//----------------------------------------------------------------------
+
+int DiskUnit::Outstanding()
+{
+    return pending->NumInList() + (current != NULL ? 1 : 0);
+}
+
+//----------------------------------------------------------------------
+// DiskUnit::Dispatch
+// 	Send the next queued request to the disk, using C-LOOK: the
+//	lowest sector at or after the disk head, or if the head is past
+//	every queued sector, the lowest sector of all.  The head only
+//	sweeps one way, so a request is never passed over more than once.
+//
+//	Called with interrupts off, when the disk is idle.
+//----------------------------------------------------------------------
+
+void DiskUnit::Dispatch()
+{
+    ListIterator<DiskRequest *> iter(pending);
+    int head = disk->HeadPosition();
+
+    ASSERT(current == NULL);
+    if (pending->IsEmpty())
+        return;
+
+    current = pending->Front();
+    for (; !iter.IsDone(); iter.Next()) {
+        if (iter.Item()->sector >= head) {
+            current = iter.Item();
+            break;
+        }
+    }
+    pending->Remove(current);
+
+    if (current->count == 0)
+        disk->FlushRequest();
+    else if (current->writing)
+        disk->WriteRequest(current->sector, current->data, current->count);
+    else
+        disk->ReadRequest(current->sector, current->data, current->count);
+}
+
+//----------------------------------------------------------------------
+// DiskUnit::CallBack
+// 	Disk interrupt handler.  Start the next request, and finish the
+//	one that is done.
+//----------------------------------------------------------------------
+
+void DiskUnit::CallBack()
+{
+    DiskRequest *finished = current;
+
+    current = NULL;
+    Dispatch();
+    Finished(finished);
+}
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
-// 	Initialize the synchronous interface to the physical disk, in turn
-//	initializing the physical disk.
+// 	Initialize the synchronous interface to the physical disks, in
+//	turn initializing the physical disks: kernel->numDisks of them,
+//	mirrored if kernel->mirrorDisks is set, otherwise striped.
 //
+//	"sectorsPerTrack", "numTracks" -- the geometry to format the disks
+//		with, or 0 to use the disks as they are
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(int sectorsPerTrack, int numTracks)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    numUnits = kernel->numDisks;
+    mirrored = kernel->mirrorDisks;
+    units = new DiskUnit *[numUnits];
+    for (int i = 0; i < numUnits; i++) {
+        units[i] = new DiskUnit(i, sectorsPerTrack, numTracks);
+        if (i == 0 || units[i]->disk->NumSectors() < unitSectors)
+            unitSectors = units[i]->disk->NumSectors();
+    }
+    if (numUnits > 1 && !mirrored) // only whole stripes
+        unitSectors -= unitSectors % StripeSectors;
 }
 
 //----------------------------------------------------------------------
@@ -39,9 +262,9 @@ SynchDisk::SynchDisk()
 
 SynchDisk::~SynchDisk()
 {
-    delete disk;
-    delete lock;
-    delete semaphore;
+    for (int i = 0; i < numUnits; i++)
+        delete units[i];
+    delete[] units;
 }
 
 //----------------------------------------------------------------------
@@ -55,10 +278,7 @@ SynchDisk::~SynchDisk()
 
 void SynchDisk::ReadSector(int sectorNumber, char *data)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    WaitFor(ReadRequest(sectorNumber, data));
 }
 
 //----------------------------------------------------------------------
@@ -72,20 +292,207 @@ void SynchDisk::ReadSector(int sectorNumber, char *data)
 
 void SynchDisk::WriteSector(int sectorNumber, char *data)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    //if(sectorNumber<0 || sectorNumber>524288)cout<<sectorNumber<<"\n";
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    WaitFor(WriteRequest(sectorNumber, data));
 }
 
 //----------------------------------------------------------------------
-// SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// SynchDisk::ReadRequest/WriteRequest
+// 	Queue a read/write of one disk sector, and return without waiting
+//	for it.  The buffer must not be touched until WaitFor returns.
+//
+//	"sectorNumber" -- the disk sector to read/write
+//	"data" -- the buffer to read into, or to write from
 //----------------------------------------------------------------------
 
-void SynchDisk::CallBack()
+DiskRequest *SynchDisk::ReadRequest(int sectorNumber, char *data)
 {
-    semaphore->V();
+    return Submit(new DiskRequest(sectorNumber, data, FALSE));
+}
+
+DiskRequest *SynchDisk::WriteRequest(int sectorNumber, char *data)
+{
+    return Submit(new DiskRequest(sectorNumber, data, TRUE));
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadRequest/WriteRequest
+// 	Queue a read/write of the "count" sectors starting at
+//	"sectorNumber", and return without waiting for it.  The disk
+//	does the whole run as one request, with one interrupt.
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"data" -- data[i] is the buffer for sector sectorNumber + i
+//	"count" -- the number of sectors
+//----------------------------------------------------------------------
+
+DiskRequest *SynchDisk::ReadRequest(int sectorNumber, char **data, int count)
+{
+    return Submit(new DiskRequest(sectorNumber, data, count, FALSE));
+}
+
+DiskRequest *SynchDisk::WriteRequest(int sectorNumber, char **data, int count)
+{
+    return Submit(new DiskRequest(sectorNumber, data, count, TRUE));
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WaitFor
+// 	Wait until "request" has been done by the disk, then de-allocate
+//	it.  Every request must be waited for exactly once.
+//----------------------------------------------------------------------
+
+void SynchDisk::WaitFor(DiskRequest *request)
+{
+    request->done->P(); // wait for interrupt
+    delete request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Make sure the sectors whose writes are done so far are on the
+//	surface of the disk, not just in its write cache: the point
+//	where a write is durable.  Return once the disk says so.
+//----------------------------------------------------------------------
+
+void SynchDisk::Flush()
+{
+    WaitFor(Submit(new DiskRequest()));
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Sync
+// 	Make sure the sectors written so far are on the disks' surfaces,
+//	and in the UNIX files that hold the disks, so they would survive
+//	a power failure or the host crashing.
+//----------------------------------------------------------------------
+
+void SynchDisk::Sync()
+{
+    Flush();
+    for (int i = 0; i < numUnits; i++)
+        units[i]->disk->Sync();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NumSectors
+// 	Return the number of sectors on the disk: on a striped set, the
+//	total of all the disks.
+//----------------------------------------------------------------------
+
+int SynchDisk::NumSectors()
+{
+    if (mirrored)
+        return unitSectors;
+    return unitSectors * numUnits;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Queue a request, for the disks it involves, and start each of
+//	them that is idle.  On one disk, the request goes to its queue as
+//	it is; otherwise:
+//	   a flush, or a write to a mirrored set, goes to every disk;
+//	   a read from a mirrored set goes to the disk Nearest picks;
+//	   a striped request is split by Stripe.
+//----------------------------------------------------------------------
+
+DiskRequest *SynchDisk::Submit(DiskRequest *request)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    ASSERT(request->count == 0 ||
+           ((request->sector >= 0) &&
+            (request->sector + request->count <= NumSectors())));
+    if (numUnits == 1)
+        units[0]->Queue(request);
+    else if (request->count == 0 || (mirrored && request->writing)) {
+        for (int i = 0; i < numUnits; i++)
+            Piece(request, i, request->sector, request->data, request->count);
+    } else if (mirrored)
+        units[Nearest(request->sector)]->Queue(request);
+    else
+        Stripe(request);
+    (void)kernel->interrupt->SetLevel(oldLevel);
+    return request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Piece
+// 	Queue a piece of "request", for "count" sectors of disk "unit"
+//	from "sectorNumber" on, or a flush if "count" is 0.  Called with
+//	interrupts off, so no piece can finish before they are all queued.
+//----------------------------------------------------------------------
+
+void SynchDisk::Piece(DiskRequest *request, int unit, int sectorNumber,
+                      char **data, int count)
+{
+    DiskRequest *piece;
+
+    if (count == 0)
+        piece = new DiskRequest();
+    else
+        piece = new DiskRequest(sectorNumber, data, count, request->writing);
+    piece->parent = request;
+    request->pieces++;
+    units[unit]->Queue(piece);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Stripe
+// 	Split a request to a striped set into one piece for each disk it
+//	involves.  Sector s is in stripe s / StripeSectors, which is on
+//	disk (stripe % numUnits); stripes i and i + numUnits are next to
+//	each other on their disk, so the sectors of a run that are on one
+//	disk are a run there too.
+//----------------------------------------------------------------------
+
+void SynchDisk::Stripe(DiskRequest *request)
+{
+    char **bufs = new char *[request->count];
+
+    for (int unit = 0; unit < numUnits; unit++) {
+        int first = 0, count = 0;
+
+        for (int i = 0; i < request->count; i++) {
+            int sector = request->sector + i;
+            int stripe = sector / StripeSectors;
+
+            if (stripe % numUnits != unit)
+                continue;
+            if (count == 0)
+                first = (stripe / numUnits) * StripeSectors +
+                        sector % StripeSectors;
+            bufs[count++] = request->data[i];
+        }
+        if (count > 0)
+            Piece(request, unit, first, bufs, count);
+    }
+    delete[] bufs;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Nearest
+// 	Return the disk of a mirrored set that a read of "sectorNumber"
+//	should go to: one with the fewest requests ahead of it, so the
+//	read waits least, and of those, the one with the shortest seek.
+//----------------------------------------------------------------------
+
+int SynchDisk::Nearest(int sectorNumber)
+{
+    int best = 0, bestWait = 0, bestSeek = 0;
+
+    for (int i = 0; i < numUnits; i++) {
+        Disk *disk = units[i]->disk;
+        int wait = units[i]->Outstanding();
+        int seek = abs(sectorNumber / disk->SectorsPerTrack() -
+                       disk->HeadPosition() / disk->SectorsPerTrack());
+
+        if (i == 0 || wait < bestWait ||
+            (wait == bestWait && seek < bestSeek)) {
+            best = i;
+            bestWait = wait;
+            bestSeek = seek;
+        }
+    }
+    return best;
 }
@@ -14,6 +14,73 @@
 #include "disk.h"
 #include "synch.h"
 #include "callback.h"
+#include "list.h"
+
+const int StripeSectors = 4; // consecutive sectors on one disk, before
+                             // a striped disk set moves to the next
+
+// The following class defines one request waiting for, or being
+// served by, the disk: a run of one or more consecutive sectors, or
+// a flush of the disk's write cache, which has no sectors.
+// The caller's buffers must stay valid until the request is done.
+//
+// On a set of several disks, a request may be split into pieces, one
+// for each disk it involves; each piece is a request of its own, for
+// sectors of that disk, and the request is done when its last piece is.
+
+class DiskRequest
+{
+public:
+    DiskRequest(int sectorNumber, char *buf, bool write);
+    DiskRequest(int sectorNumber, char **bufs, int n, bool write);
+    DiskRequest();    // a flush
+    ~DiskRequest();
+
+    int sector;       // First sector to read or write
+    int count;        // Number of sectors; 0 for a flush
+    char **data;      // data[i] is the buffer to read into, or
+                      // write from, for sector + i
+    bool writing;     // Is this a write?
+    Semaphore *done;  // V'ed by the interrupt handler when the
+                      // request completes
+    DiskRequest *parent; // The request this is a piece of, or NULL
+    int pieces;       // Number of its pieces not yet done
+
+private:
+    char *one;        // "data" of a one-sector request
+};
+
+// The following class defines one of the disks under a SynchDisk,
+// with the queue of requests it is not yet working on.  Each time
+// the disk finishes a request, the next one is chosen in elevator
+// (C-LOOK) order: the nearest sector at or past the disk head, or,
+// when there is none, the lowest sector in the queue.
+
+class DiskUnit : public CallBackObj
+{
+public:
+    DiskUnit(int unit, int sectorsPerTrack, int numTracks);
+    ~DiskUnit();
+
+    void Queue(DiskRequest *request); // Queue a request for this disk;
+                                      // called with interrupts off
+    int Outstanding();                // Number of requests queued
+                                      // or being served
+
+    void CallBack(); // Called by the disk device interrupt
+                     // handler, to signal that the
+                     // current disk operation is complete.
+
+    Disk *disk;                         // Raw disk device
+
+private:
+    SortedList<DiskRequest *> *pending; // Requests not yet sent to
+                                        // the disk, by sector number
+    DiskRequest *current;               // Request the disk is working
+                                        // on, NULL if it is idle
+
+    void Dispatch();                    // Start the next request
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -22,35 +89,68 @@
 // (Also, the physical characteristics of the disk device assume that
 // only one operation can be requested at a time).
 //
-// This class provides the abstraction that for any individual thread
-// making a request, it waits around until the operation finishes before
-// returning.
+// The "disk" may really be a set of disks (see -dr), each with its own
+// queue, so that they can all work at once:
+//   RAID-0 -- the sectors are striped across the disks, StripeSectors
+//	on each in turn; a run of sectors is split into a piece for each
+//	disk, and the pieces are served in parallel.
+//   RAID-1 -- every disk has a copy of every sector.  A write goes to
+//	all of them; a read goes to the least busy one, and of those, to
+//	the one whose head is nearest.
+//
+// ReadSector/WriteSector provide the abstraction that for any individual
+// thread making a request, it waits around until the operation finishes
+// before returning.  ReadRequest/WriteRequest only queue the request;
+// the caller waits for it later with WaitFor, so that it can have
+// several requests outstanding at once.  A request for a run of
+// consecutive sectors goes to each disk as a single request.
 
-class SynchDisk : public CallBackObj
+class SynchDisk
 {
 public:
-    SynchDisk();  // Initialize a synchronous disk,
-                  // by initializing the raw Disk.
+    SynchDisk(int sectorsPerTrack = 0, int numTracks = 0);
+                  // Initialize a synchronous disk,
+                  // by initializing the raw Disks, with
+                  // this geometry if they are being formatted
     ~SynchDisk(); // De-allocate the synch disk data
 
     void ReadSector(int sectorNumber, char *data);
     // Read/write a disk sector, returning
     // only once the data is actually read
-    // or written.  These call
-    // Disk::ReadRequest/WriteRequest and
-    // then wait until the request is done.
+    // or written.
     void WriteSector(int sectorNumber, char *data);
 
-    void CallBack(); // Called by the disk device interrupt
-                     // handler, to signal that the
-                     // current disk operation is complete.
+    DiskRequest *ReadRequest(int sectorNumber, char *data);
+    // Queue a read/write and return at once
+    DiskRequest *WriteRequest(int sectorNumber, char *data);
+    DiskRequest *ReadRequest(int sectorNumber, char **data, int count);
+    // Queue a read/write of "count"
+    // sectors from "sectorNumber" on
+    DiskRequest *WriteRequest(int sectorNumber, char **data, int count);
+    void WaitFor(DiskRequest *request);
+    // Wait until "request" is done, then
+    // de-allocate it
+    void Flush();
+    // Make sure the sectors written so far
+    // are out of the disk's write cache,
+    // so they survive a power failure
+    void Sync();
+    // Flush, and make sure they will
+    // survive a crash of the host too
+    int NumSectors();
+    // Size of the disk, in sectors
 
 private:
-    Disk *disk;           // Raw disk device
-    Semaphore *semaphore; // To synchronize requesting thread
-                          // with the interrupt handler
-    Lock *lock;           // Only one read/write request
-                          // can be sent to the disk at a time
+    DiskUnit **units;  // The disks
+    int numUnits;      // How many there are
+    bool mirrored;     // RAID-1, rather than RAID-0?
+    int unitSectors;   // Sectors used on each disk
+
+    DiskRequest *Submit(DiskRequest *request); // Queue a request
+    void Piece(DiskRequest *request, int unit, int sectorNumber,
+               char **data, int count);        // Queue a piece of it
+    void Stripe(DiskRequest *request);         // Queue its RAID-0 pieces
+    int Nearest(int sectorNumber);             // Mirror to read from
 };
 
 #endif // SYNCHDISK_H
@@ -2,6 +2,11 @@
 //	Routines to manage a bitmap -- an array of bits each of which
 //	can be either on or off.  Represented as an array of integers.
 //
+//	Searches work a word at a time: a word with no clear bits is
+//	skipped by looking at one bit of "full", and a word with some is
+//	searched with a count-trailing-zeros instruction.  The bits past
+//	"numBits" in the last word are kept set, so they are never found.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -26,15 +31,14 @@ Bitmap::Bitmap(int numItems)
 
     numBits = numItems;
     numWords = divRoundUp(numBits, BitsInWord);
+    numFullWords = divRoundUp(numWords, BitsInWord);
     map = new unsigned int[numWords];
+    full = new unsigned int[numFullWords];
     for (i = 0; i < numWords; i++)
     {
         map[i] = 0; // initialize map to keep Purify happy
     }
-    for (i = 0; i < numBits; i++)
-    {
-        Clear(i);
-    }
+    Recount();
 }
 
 //----------------------------------------------------------------------
@@ -44,9 +48,54 @@ Bitmap::Bitmap(int numItems)
 
 Bitmap::~Bitmap()
 {
+    delete[] full;
     delete[] map;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Recompute the count of clear bits, and which words are full, from
+//	the bits in "map".  Called whenever "map" is filled in directly,
+//	such as when it is read from disk.
+//----------------------------------------------------------------------
+
+void Bitmap::Recount()
+{
+    int w;
+
+    if (numBits % BitsInWord != 0)
+    {
+        map[numWords - 1] |= ~0u << (numBits % BitsInWord);
+    }
+    for (w = 0; w < numFullWords; w++)
+    {
+        full[w] = 0;
+    }
+    numClear = 0;
+    for (w = 0; w < numWords; w++)
+    {
+        numClear += BitsInWord - __builtin_popcount(map[w]);
+        UpdateWord(w);
+    }
+}
+
+//----------------------------------------------------------------------
+// Bitmap::UpdateWord
+// 	Set or clear the bit of "full" for word "w" of the map.
+//----------------------------------------------------------------------
+
+void Bitmap::UpdateWord(int w)
+{
+    if (map[w] == ~0u)
+    {
+        full[w / BitsInWord] |= 1u << (w % BitsInWord);
+    }
+    else
+    {
+        full[w / BitsInWord] &= ~(1u << (w % BitsInWord));
+    }
+}
+
 //----------------------------------------------------------------------
 // Bitmap::Set
 // 	Set the "nth" bit in a bitmap.
@@ -58,7 +107,13 @@ void Bitmap::Mark(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if (!Test(which))
+    {
+        map[which / BitsInWord] |= 1u << (which % BitsInWord);
+        numClear--;
+        UpdateWord(which / BitsInWord);
+        WordChanged(which / BitsInWord);
+    }
 
     ASSERT(Test(which));
 }
@@ -74,7 +129,13 @@ void Bitmap::Clear(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if (Test(which))
+    {
+        map[which / BitsInWord] &= ~(1u << (which % BitsInWord));
+        numClear++;
+        UpdateWord(which / BitsInWord);
+        WordChanged(which / BitsInWord);
+    }
 
     ASSERT(!Test(which));
 }
@@ -90,7 +151,7 @@ bool Bitmap::Test(int which) const
 {
     ASSERT(which >= 0 && which < numBits);
 
-    if (map[which / BitsInWord] & (1 << (which % BitsInWord)))
+    if (map[which / BitsInWord] & (1u << (which % BitsInWord)))
     {
         return TRUE;
     }
@@ -100,6 +161,67 @@ bool Bitmap::Test(int which) const
     }
 }
 
+//----------------------------------------------------------------------
+// Bitmap::NextClear
+// 	Return the first clear bit at or after "which", or numBits if
+//	there is none.  Full words are skipped using "full", up to a
+//	whole word of them at a time.
+//----------------------------------------------------------------------
+
+int Bitmap::NextClear(int which) const
+{
+    if (which >= numBits)
+    {
+        return numBits;
+    }
+
+    int w = which / BitsInWord;
+    unsigned int bits = ~map[w] & (~0u << (which % BitsInWord));
+
+    if (bits != 0)
+    {
+        return w * BitsInWord + __builtin_ctz(bits);
+    }
+    for (w++; w < numWords;)
+    {
+        bits = ~full[w / BitsInWord] & (~0u << (w % BitsInWord));
+        if (bits == 0)
+        {
+            w = (w / BitsInWord + 1) * BitsInWord;
+            continue;
+        }
+        w = (w / BitsInWord) * BitsInWord + __builtin_ctz(bits);
+        if (w >= numWords)
+        {
+            break;
+        }
+        return w * BitsInWord + __builtin_ctz(~map[w]);
+    }
+    return numBits;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextSet
+// 	Return the first set bit at or after "which", or numBits if there
+//	is none.  Empty words are skipped a word at a time.
+//----------------------------------------------------------------------
+
+int Bitmap::NextSet(int which) const
+{
+    int w = which / BitsInWord;
+    unsigned int bits = map[w] & (~0u << (which % BitsInWord));
+
+    while (bits == 0)
+    {
+        if (++w == numWords)
+        {
+            return numBits;
+        }
+        bits = map[w];
+    }
+    return min(w * BitsInWord + __builtin_ctz(bits), numBits);
+}
+
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
 // 	Return the number of the first bit which is clear.
@@ -111,35 +233,95 @@ bool Bitmap::Test(int which) const
 
 int Bitmap::FindAndSet()
 {
-    for (int i = 0; i < numBits; i++)
+    int i;
+
+    if (numClear == 0)
     {
-        if (!Test(i))
-        {
-            Mark(i);
-            return i;
-        }
+        return -1;
     }
-    return -1;
+    i = NextClear(0);
+    ASSERT(i < numBits);
+    Mark(i);
+    return i;
 }
 
 //----------------------------------------------------------------------
-// Bitmap::NumClear
-// 	Return the number of clear bits in the bitmap.
-//	(In other words, how many bits are unallocated?)
+// Bitmap::FindAndSetRun
+// 	Allocate a contiguous run of bits.  Scan the whole map once, a
+//	run at a time, remembering the smallest run of clear bits that is at least
+//	"length" long (best fit), and the longest run seen in case
+//	no run is long enough.  An exact fit ends the scan early.
+//
+//	Set the first min(length, run size) bits of the chosen run,
+//	store that count in "found" and return the first bit number.
+//	If no bits are clear, return -1.
+//
+//	"length" is the number of bits wanted
+//	"found" receives the number of bits actually set
 //----------------------------------------------------------------------
 
-int Bitmap::NumClear() const
+int Bitmap::FindAndSetRun(int length, int *found)
 {
-    int count = 0;
+    int bestStart = -1, bestLength = 0; // smallest run that fits
+    int longStart = -1, longLength = 0; // longest run that does not
+    int i = 0;
 
-    for (int i = 0; i < numBits; i++)
+    ASSERT(length > 0);
+    if (numClear == 0)
+    {
+        return -1;
+    }
+    while ((i = NextClear(i)) < numBits)
+    {
+        int start = i;
+        i = NextSet(start);
+        int runLength = i - start;
+        if (runLength >= length)
+        {
+            if (bestStart == -1 || runLength < bestLength)
+            {
+                bestStart = start;
+                bestLength = runLength;
+            }
+            if (runLength == length)
+            {
+                break; // cannot do better than an exact fit
+            }
+        }
+        else if (runLength > longLength)
+        {
+            longStart = start;
+            longLength = runLength;
+        }
+    }
+
+    if (bestStart == -1)
     {
-        if (!Test(i))
+        if (longStart == -1)
         {
-            count++;
+            return -1;
         }
+        bestStart = longStart;
+        length = longLength;
     }
-    return count;
+    for (i = 0; i < length; i++)
+    {
+        Mark(bestStart + i);
+    }
+    *found = length;
+    return bestStart;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NumClear
+// 	Return the number of clear bits in the bitmap.
+//	(In other words, how many bits are unallocated?)  The count is
+//	kept up to date by Mark and Clear.
+//----------------------------------------------------------------------
+
+int Bitmap::NumClear() const
+{
+    return numClear;
 }
 
 //----------------------------------------------------------------------
@@ -189,8 +371,15 @@ void Bitmap::SelfTest()
         Mark(i);
     }
     ASSERT(FindAndSet() == -1); // bitmap should be full!
+    ASSERT(NumClear() == 0);
+    Clear(numBits - 1);
+    Clear(3);
+    Clear(4);
+    ASSERT(FindAndSetRun(2, &i) == 3 && i == 2); // exact fit
+    ASSERT(FindAndSetRun(2, &i) == numBits - 1 && i == 1); // what's left
     for (i = 0; i < numBits; i++)
     {
         Clear(i);
     }
+    ASSERT(NumClear() == numBits);
 }
@@ -5,6 +5,10 @@
 //	Represented as an array of unsigned integers, on which we do
 //	modulo arithmetic to find the bit we are interested in.
 //
+//	So that a search does not have to look at every bit, the bitmap
+//	also keeps a count of the clear bits, and a second, smaller array
+//	with one bit per word of the map, set when that word is full.
+//
 //	The bitmap can be parameterized with with the number of bits being
 //	managed.
 //
@@ -35,7 +39,7 @@ class Bitmap
 public:
     Bitmap(int numItems); // Initialize a bitmap, with "numItems" bits
                           // initially, all bits are cleared.
-    ~Bitmap();            // De-allocate bitmap
+    virtual ~Bitmap();    // De-allocate bitmap
 
     void Mark(int which);       // Set the "nth" bit
     void Clear(int which);      // Clear the "nth" bit
@@ -43,7 +47,15 @@ public:
     int FindAndSet();           // Return the # of a clear bit, and as a side
         // effect, set the bit.
         // If no bits are clear, return -1.
+    int FindAndSetRun(int length, int *found);
+        // Find a run of clear bits, preferring the
+        // smallest run of at least "length" bits
+        // (best fit), or else the longest run there
+        // is.  Set up to "length" bits of it, store
+        // how many in "found" and return the first.
+        // If no bits are clear, return -1.
     int NumClear() const; // Return the number of clear bits
+    int NumItems() const { return numBits; } // Return the number of bits
 
     void Print() const; // Print contents of bitmap
     void SelfTest();    // Test whether bitmap is working
@@ -55,6 +67,22 @@ protected:
                        //  multiple of the number of bits in
                        //  a word)
     unsigned int *map; // bit storage
+    int numClear;      // number of clear bits
+    unsigned int *full; // bit "w" is set when word "w" of the map
+                        // has no clear bits
+    int numFullWords;   // number of words of "full"
+
+    void Recount(); // Recompute numClear and "full" from "map",
+                    // after "map" was changed directly
+    virtual void WordChanged(int w) {} // Called when Mark or Clear
+                                       // changes word "w" of "map"
+
+private:
+    void UpdateWord(int w);    // Recompute the "full" bit of word "w"
+    int NextClear(int which) const; // First clear bit at or after
+                                    // "which", or numBits if none
+    int NextSet(int which) const;   // First set bit at or after
+                                    // "which", or numBits if none
 };
 
 #endif // BITMAP_H
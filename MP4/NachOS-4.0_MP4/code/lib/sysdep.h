@@ -53,6 +53,12 @@ extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
+// Map an open file into memory, flush it, and unmap it.
+// For serving the simulated disk without a system call per sector.
+extern char *MapFile(int fd, int size);
+extern void SyncMappedFile(char *addr, int size);
+extern void UnmapFile(char *addr, int size);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
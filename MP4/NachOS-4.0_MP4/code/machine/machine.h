@@ -146,6 +146,10 @@ public:
 	// Read or write 1, 2, or 4 bytes of virtual
 	// memory (at addr).  Return FALSE if a
 	// correct translation couldn't be found.
+	char *UserSpan(int addr, int size, bool writing, int *length);
+	// Translate the start of a user buffer;
+	// return where it is in mainMemory and how
+	// many bytes are contiguous there, or NULL
 private:
 	// Routines internal to the machine simulation -- DO NOT call these directly
 	void DelayedLoad(int nextReg, int nextVal);
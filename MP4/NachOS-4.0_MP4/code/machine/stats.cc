@@ -19,7 +19,9 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
-    numDiskReads = numDiskWrites = 0;
+    numDiskReads = numDiskWrites = numDiskDestages = maxDisksBusy = 0;
+    numCacheHits = numCacheMisses = numReadAheads = 0;
+    numJournalCommits = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
 }
@@ -36,7 +38,13 @@ Statistics::Print()
     cout << "Ticks: total " << totalTicks << ", idle " << idleTicks;
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
     cout << "Disk I/O: reads " << numDiskReads;
-		cout << ", writes " << numDiskWrites << "\n";
+		cout << ", writes " << numDiskWrites;
+		cout << ", destages " << numDiskDestages;
+		cout << ", most disks busy at once " << maxDisksBusy << "\n";
+    cout << "Block cache: hits " << numCacheHits;
+		cout << ", misses " << numCacheMisses;
+		cout << ", read ahead " << numReadAheads << "\n";
+    cout << "Journal: commits " << numJournalCommits << "\n";
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
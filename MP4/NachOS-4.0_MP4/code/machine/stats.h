@@ -30,6 +30,14 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numDiskDestages;	// number of runs written from the disk's
+				// write cache to its surface
+    int maxDisksBusy;		// most disks with a request in progress
+				// at the same time
+    int numCacheHits;		// number of sectors found in the block cache
+    int numCacheMisses;		// number of sectors the block cache had to load
+    int numReadAheads;		// number of sectors loaded before they were used
+    int numJournalCommits;	// number of metadata journal commits
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
@@ -169,6 +169,35 @@ bool Machine::WriteMem(int addr, int size, int value)
 	return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::UserSpan
+//      Find where the start of the "size" byte user buffer at virtual
+//	address "addr" lives in physical memory, so the kernel can move
+//	data straight to or from it.  A buffer is only contiguous up to
+//	the end of its page, so a caller walks a larger buffer one span
+//	at a time.
+//
+//   	Returns a pointer into mainMemory, with "*length" set to the
+//	number of bytes that are contiguous there, or NULL if the page is
+//	not mapped (or is read-only, when "writing").  Unlike ReadMem and
+//	WriteMem, no exception is raised; the caller fails the system call.
+//
+//	"addr" -- the virtual address of the buffer
+//	"size" -- the number of bytes left in the buffer
+//	"writing" -- TRUE if the kernel is going to write to the buffer
+//	"length" -- the place to store the length of the span
+//----------------------------------------------------------------------
+
+char *Machine::UserSpan(int addr, int size, bool writing, int *length)
+{
+	int physicalAddress;
+
+	if (Translate(addr, &physicalAddress, 1, writing) != NoException)
+		return NULL;
+	*length = min(size, PageSize - (int)((unsigned)addr % PageSize));
+	return &mainMemory[physicalAddress];
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using
@@ -0,0 +1,24 @@
+../build.linux/nachos -f
+../build.linux/nachos -b - <<END
+-mkdir /t0
+-mkdir /t1
+-mkdir /t2
+-cp num_100.txt /t0/f1
+-mkdir /t0/aa
+-mkdir /t0/bb
+-mkdir /t0/cc
+-cp num_100.txt /t0/bb/f1
+-cp num_100.txt /t0/bb/f2
+-cp num_100.txt /t0/bb/f3
+-cp num_100.txt /t0/bb/f4
+# do -lr
+-lr /
+# do -l
+-l /t0
+# do -r remove f3, then -lr
+-r /t0/bb/f3
+-lr /
+# do -rr remove dir bb, then -lr
+-rr /t0/bb
+-lr /
+END
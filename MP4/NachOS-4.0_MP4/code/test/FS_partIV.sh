@@ -0,0 +1,9 @@
+make clean
+make
+../build.linux/nachos -f
+../build.linux/nachos -cp FS_test3 /FS_test3
+../build.linux/nachos -e /FS_test3
+../build.linux/nachos -p /file3
+../build.linux/nachos -cp FS_test4 /FS_test4
+../build.linux/nachos -e /FS_test4
+../build.linux/nachos -p /file4
@@ -0,0 +1,71 @@
+#include "syscall.h"
+
+int main(void)
+{
+	// gathered and positioned I/O: WriteV, ReadV, PWrite and PRead
+	char a[] = "abcdefghij", b[] = "klmnopq", c[] = "rstuvwxyz\n";
+	char check[] = "XYcdefghijklmnopqrstuvwxyz\n";
+	char head[10], tail[17], part[5];
+	IoVec iov[3];
+	OpenFileId fid;
+	int count, success, i;
+	success = Create("/file3", 64);
+	if (success != 1)
+		MSG("Failed on creating file");
+	fid = Open("/file3");
+	if (fid < 0)
+		MSG("Failed on opening file");
+	iov[0].buffer = a; iov[0].size = 10;
+	iov[1].buffer = b; iov[1].size = 7;
+	iov[2].buffer = c; iov[2].size = 10;
+	count = WriteV(iov, 3, fid);
+	if (count != 27)
+		MSG("Failed on WriteV");
+	count = PWrite("XY", 2, 0, fid);
+	if (count != 2)
+		MSG("Failed on PWrite");
+	success = Close(fid);
+	if (success != 1)
+		MSG("Failed on closing file");
+
+	fid = Open("/file3");
+	if (fid < 0)
+		MSG("Failed on opening file");
+	iov[0].buffer = head; iov[0].size = 10;
+	count = ReadV(iov, 1, fid);
+	if (count != 10)
+		MSG("Failed on ReadV");
+	count = PRead(part, 5, 20, fid);	// must not move the seek position
+	if (count != 5)
+		MSG("Failed on PRead");
+	for (i = 0; i < 5; ++i)
+	{
+		if (part[i] != check[20 + i])
+			MSG("Failed: PRead read wrong result");
+	}
+	iov[0].buffer = part; iov[0].size = 5;
+	iov[1].buffer = tail; iov[1].size = 12;
+	count = ReadV(iov, 2, fid);
+	if (count != 17)
+		MSG("Failed on ReadV");
+	for (i = 0; i < 10; ++i)
+	{
+		if (head[i] != check[i])
+			MSG("Failed: ReadV read wrong result");
+	}
+	for (i = 0; i < 5; ++i)
+	{
+		if (part[i] != check[10 + i])
+			MSG("Failed: PRead moved the seek position");
+	}
+	for (i = 0; i < 12; ++i)
+	{
+		if (tail[i] != check[15 + i])
+			MSG("Failed: ReadV read wrong result");
+	}
+	success = Close(fid);
+	if (success != 1)
+		MSG("Failed on closing file");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,60 @@
+#include "syscall.h"
+
+int main(void)
+{
+	// mapped files: Mmap, Munmap and Sync
+	char test[] = "abcdefghijklmnopqrstuvwxyz\n";
+	char c;
+	char *p, *q;
+	OpenFileId fid;
+	int count, success, i;
+	success = Create("/file4", 256);
+	if (success != 1)
+		MSG("Failed on creating file");
+	fid = Open("/file4");
+	if (fid < 0)
+		MSG("Failed on opening file");
+	count = Write(test, 27, fid);
+	if (count != 27)
+		MSG("Failed on writing file");
+	p = Mmap(fid, 256);
+	if ((int)p < 0)
+		MSG("Failed on Mmap");
+	success = Close(fid);		// the mapping keeps the file open
+	if (success != 1)
+		MSG("Failed on closing file");
+	for (i = 0; i < 27; ++i)
+	{
+		if (p[i] != test[i])
+			MSG("Failed: mapped page has wrong contents");
+	}
+	p[0] = 'A';
+	p[200] = 'Z';
+	success = Munmap(p);
+	if (success != 1)
+		MSG("Failed on Munmap");
+	if (Munmap(p) != 0)
+		MSG("Failed: Munmap removed a mapping twice");
+	Sync();
+
+	fid = Open("/file4");
+	if (fid < 0)
+		MSG("Failed on opening file");
+	if (PRead(&c, 1, 0, fid) != 1 || c != 'A')
+		MSG("Failed: Munmap did not write the page back");
+	if (PRead(&c, 1, 200, fid) != 1 || c != 'Z')
+		MSG("Failed: Munmap did not write the page back");
+	q = Mmap(fid, 256);		// the range freed by Munmap is reused
+	if (q != p)
+		MSG("Failed: Mmap did not reuse the unmapped range");
+	if (q[1] != 'b' || q[200] != 'Z')
+		MSG("Failed: mapped page has wrong contents");
+	success = Munmap(q);
+	if (success != 1)
+		MSG("Failed on Munmap");
+	success = Close(fid);
+	if (success != 1)
+		MSG("Failed on closing file");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -15,6 +15,8 @@
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "blockcache.h"
+#include "inodetable.h"
 #include "post.h"
 #include "synchconsole.h"
 
@@ -34,11 +36,21 @@ Kernel::Kernel(int argc, char **argv)
     formatFlag = FALSE;
 #endif
     reliability = 1;            // network reliability, default is 1.0
+    cacheBlocks = DefaultCacheBlocks;
+    sectorsPerTrack = DefaultSectorsPerTrack;
+    numTracks = DefaultNumTracks;
     hostName = 0;               // machine id, also UNIX socket name
+    mapDisk = FALSE;
+    writeCacheSectors = 0;
+    numDisks = 1;
+    mirrorDisks = FALSE;
                                 // 0 is the default machine id
 								
 	// MP4 mod tag
 	execfileNum = 0; // dummy operation to keep valgrind happy
+	threadNum = 0;
+	for (int i = 0; i < 10; i++)
+		t[i] = NULL;	// every program slot is free
 								
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-rs") == 0) {
@@ -64,6 +76,41 @@ Kernel::Kernel(int argc, char **argv)
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
 #endif
+        } else if (strcmp(argv[i], "-b") == 0) {
+            // a batch read from stdin (see main.cc) must not have
+            // its characters taken by the console
+            ASSERT(i + 1 < argc);
+            if (strcmp(argv[i + 1], "-") == 0 && consoleIn == NULL)
+                consoleIn = "/dev/null";
+            i++;
+        } else if (strcmp(argv[i], "-dm") == 0) {
+            mapDisk = TRUE;
+        } else if (strcmp(argv[i], "-dwc") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            writeCacheSectors = atoi(argv[i + 1]);
+            ASSERT(writeCacheSectors >= 0);
+            i++;
+        } else if (strcmp(argv[i], "-dr") == 0) {
+            ASSERT(i + 2 < argc);   // RAID level, number of disks
+            ASSERT(strcmp(argv[i + 1], "0") == 0 ||
+                   strcmp(argv[i + 1], "1") == 0);
+            mirrorDisks = (strcmp(argv[i + 1], "1") == 0);
+            numDisks = atoi(argv[i + 2]);
+            ASSERT(numDisks > 0);
+            i += 2;
+        } else if (strcmp(argv[i], "-dg") == 0) {
+            ASSERT(i + 2 < argc);   // sectors per track, tracks
+            sectorsPerTrack = atoi(argv[i + 1]);
+            numTracks = atoi(argv[i + 2]);
+            ASSERT(sectorsPerTrack > 0 && numTracks > 0);
+            ASSERT(numTracks <= (0x7fffffff / SectorSize - 1) / sectorsPerTrack);
+                                    // the UNIX file must fit in 2GB
+            i += 2;
+        } else if (strcmp(argv[i], "-bc") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            cacheBlocks = atoi(argv[i + 1]);
+            ASSERT(cacheBlocks >= MinCacheBlocks);
+            i++;
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
             reliability = atof(argv[i + 1]);
@@ -80,6 +127,11 @@ Kernel::Kernel(int argc, char **argv)
 	    	cout << "Partial usage: nachos [-nf]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
+            cout << "Partial usage: nachos [-bc cacheBlocks]\n";
+            cout << "Partial usage: nachos [-dm]\n";
+            cout << "Partial usage: nachos [-dwc writeCacheSectors]\n";
+            cout << "Partial usage: nachos [-dr raidLevel numDisks]\n";
+            cout << "Partial usage: nachos [-dg sectorsPerTrack numTracks]\n";
 		}
     }
 }
@@ -105,14 +157,23 @@ Kernel::Initialize()
     stats = new Statistics();		// collect statistics
     interrupt = new Interrupt;		// start up interrupt handling
     scheduler = new Scheduler();	// initialize the ready queue
+    programDone = new Semaphore("program done", 0);
     alarm = new Alarm(randomSlice);	// start up time slicing
     machine = new Machine(debugUserProg);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+#ifndef FILESYS_STUB
+    if (formatFlag)                 // the geometry only applies to a new disk
+        synchDisk = new SynchDisk(sectorsPerTrack, numTracks);
+    else
+#endif
+        synchDisk = new SynchDisk();
+    blockCache = new BlockCache(synchDisk, cacheBlocks);
 #ifdef FILESYS_STUB
+    inodeTable = NULL;
     fileSystem = new FileSystem();
 #else
+    inodeTable = new InodeTable();
     fileSystem = new FileSystem(formatFlag);
 #endif // FILESYS_STUB
 
@@ -146,15 +207,23 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
+#ifndef FILESYS_STUB
+    fileSystem->Sync();		// while the disk and interrupts still work
+#endif
+    blockCache->Flush();
+    synchDisk->Sync();
     delete stats;
     delete interrupt;
     delete scheduler;
+    delete programDone;
     delete alarm;
     delete machine;
     delete synchConsoleIn;
     delete synchConsoleOut;
-    delete synchDisk;
     delete fileSystem;
+    delete inodeTable;
+    delete blockCache;
+    delete synchDisk;
 	
 	// Mp4 mod tag
 	/*
@@ -277,6 +346,7 @@ Kernel::NetworkTest() {
 void ForkExecute(Thread *t)
 {
 	if ( !t->space->Load(t->getName()) ) {
+	kernel->ProgramExit();
     	return;             // executable not found
     }
 	
@@ -294,14 +364,31 @@ void Kernel::ExecAll()
 }
 
 
-int Kernel::Exec(char* name)
+//----------------------------------------------------------------------
+// Kernel::Exec
+// 	Start the program "name" in a new thread, in the first free slot
+//	of t[]; slot 0 is the main thread's ID.  The slot is freed again
+//	by ProgramExit, so any number of programs can be run one after
+//	another, up to 9 at once.  Return the slot, which is the thread's
+//	ID.
+//
+//	"wait" -- V programDone when the program ends, for a caller that
+//		waits for it
+//----------------------------------------------------------------------
+
+int Kernel::Exec(char* name, bool wait)
 {
-	t[threadNum] = new Thread(name, threadNum);
-	t[threadNum]->space = new AddrSpace();
-	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
-	threadNum++;
+	int slot;
+
+	for (slot = 1; slot < 10 && t[slot] != NULL; slot++)
+		;
+	ASSERT(slot < 10);		// size of t[]
+	t[slot] = new Thread(name, slot);
+	waited[slot] = wait;
+	t[slot]->space = new AddrSpace();
+	t[slot]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[slot]);
 
-	return threadNum-1;
+	return slot;
 /*
     cout << "Total threads number is " << execfileNum << endl;
     for (int n=1;n<=execfileNum;n++) {
@@ -329,6 +416,27 @@ int Kernel::Exec(char* name)
 //  cout << "after ThreadedKernel:Run();" << endl;  // unreachable
 }
 
+//----------------------------------------------------------------------
+// Kernel::ProgramExit
+// 	The program of the current thread has ended (or could not be
+//	loaded): delete its address space, which writes back the files
+//	it left mapped and closes the ones it left open, free its slot
+//	in t[], and tell whoever waits for it.  The thread finishes
+//	right after.
+//----------------------------------------------------------------------
+
+void Kernel::ProgramExit()
+{
+	int slot = currentThread->getID();
+
+	ASSERT(slot > 0 && slot < 10 && t[slot] == currentThread);
+	delete currentThread->space;
+	currentThread->space = NULL;	// so Finish doesn't save its state
+	t[slot] = NULL;
+	if (waited[slot])
+		programDone->V();
+}
+
 #ifdef FILESYS_STUB
 int Kernel::CreateFile(char *filename)
 {
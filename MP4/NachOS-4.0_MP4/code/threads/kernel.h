@@ -24,6 +24,9 @@ class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class BlockCache;
+class InodeTable;
+class Semaphore;
 
 
 
@@ -41,7 +44,8 @@ class Kernel {
 	void PrepareToEnd(); // called before all running programs end
 	
 	void ExecAll();
-	int Exec(char* name);
+	int Exec(char* name, bool wait = FALSE);
+	void ProgramExit();	// the current thread's program is done
     void ThreadSelfTest();	// self test of threads and synchronization
 	
     void ConsoleTest();         // interactive console self test
@@ -64,15 +68,24 @@ class Kernel {
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+    BlockCache *blockCache;	// sector cache in front of synchDisk
+    InodeTable *inodeTable;	// file headers of open files
+    Semaphore *programDone;	// V'd when a program Exec'd with "wait"
+				// ends
     FileSystem *fileSystem;     
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
 
     int hostName;               // machine identifier
+    bool mapDisk;		// serve the disk from a mapping of its file
+    int writeCacheSectors;	// size of the disk's write cache; 0 if none
+    int numDisks;		// disks under the file system
+    bool mirrorDisks;		// RAID-1 if several, otherwise RAID-0
 
   private:
 
-	Thread* t[10];
+	Thread* t[10];		// the running programs; NULL if free
+	bool waited[10];	// programDone is V'd when t[i] ends
 	char*   execfile[10];
 	int execfileNum;
 	int threadNum;
@@ -84,6 +97,9 @@ class Kernel {
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
 #endif
+    int sectorsPerTrack;        // geometry to format the disk with
+    int numTracks;
+    int cacheBlocks;            // size of the block cache, in sectors
 };
 
 
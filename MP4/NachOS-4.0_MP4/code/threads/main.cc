@@ -5,7 +5,9 @@
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
 //              -f -cp <unix file> <nachos file>
-//              -p <nachos file> -r <nachos file> -l -D
+//              -cpm <unix file>... <nachos directory>
+//              -p <nachos file> -r <nachos file> -l -D -fsck
+//              -b <batch file>
 //              -n <network reliability> -m <machine id>
 //              -z -K -C -N
 //
@@ -24,11 +26,21 @@
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
-//    -cp copies a file from UNIX to Nachos
+//    -dg <sectors per track> <tracks> gives the disk formatted by -f
+//       that geometry, instead of the default
+//    -dr <0|1> <n> puts the file system on n disks, striped (RAID-0)
+//       or mirrored (RAID-1); they must be given every time, and
+//       formatted together
+//    -cp copies a file from UNIX to Nachos; it may be given many times
+//    -cpm copies any number of UNIX files into a Nachos directory,
+//       under their own names
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system
+//    -fsck checks the file system, and repairs the free map
+//    -b runs the commands in a batch file ("-" for stdin), one per
+//       line, in this one kernel; see RunBatch
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -45,6 +57,7 @@
 #include "filesys.h"
 #include "openfile.h"
 #include "sysdep.h"
+#include "synch.h"
 
 // global variables
 Kernel *kernel;
@@ -63,30 +76,42 @@ Cleanup(int x)
 }
 
 //-------------------------------------------------------------------
-// Constant used by "Copy" and "Print"
-//   It is the number of bytes read from the Unix file (for Copy)
-//   or the Nachos file (for Print) by each read operation
+// Constant used by "Print"
+//   It is the number of bytes read from the Nachos file
+//   by each read operation
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+//-------------------------------------------------------------------
+// Constant used by "Copy"
+//   It is the number of bytes read from the Unix file, and written
+//   to the Nachos file, by each operation.  Large, so most of each
+//   write is whole sectors that go straight to the disk cache.
+//-------------------------------------------------------------------
+static const int CopyTransferSize = 64 * 1024;
+
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
-//      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//      Copy the contents of the UNIX file "from" to the Nachos file "to".
+//	All of the file's sectors are allocated up front, so they come
+//	out as one extent, and the data is then streamed in
+//	CopyTransferSize chunks.  Return FALSE if the copy failed.
 //----------------------------------------------------------------------
 
-static void Copy(char *from, char *to)
+static bool Copy(char *from, char *to)
 {
     int fd;
     OpenFile *openFile;
-    int amountRead, fileLength;
+    int amountRead, fileLength, amountWritten;
+    int filled;
     char *buffer;
 
     // Open UNIX file
     if ((fd = OpenForReadWrite(from, FALSE)) < 0)
     {
         printf("Copy: couldn't open input file %s\n", from);
-        return;
+        return FALSE;
     }
 
     // Figure out length of UNIX file
@@ -100,21 +125,62 @@ static void Copy(char *from, char *to)
     { // Create Nachos file
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
-        return;
+        return FALSE;
     }
 
     openFile = kernel->fileSystem->Open(to);
     ASSERT(openFile != NULL);
 
-    // Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * TransferSize)) > 0)
-        openFile->Write(buffer, amountRead);
+    // Allocate the whole file at once, rather than a chunk at a time
+    filled = kernel->fileSystem->Fill(openFile, 0, fileLength);
+
+    // Copy the data in CopyTransferSize chunks
+    amountWritten = 0;
+    buffer = new char[CopyTransferSize];
+    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * CopyTransferSize)) > 0)
+        amountWritten += openFile->Write(buffer, amountRead);
+    if (amountWritten < fileLength)
+        printf("Copy: only %d bytes of %s copied\n", amountWritten, from);
+
+    // If the UNIX file came up short, the sectors allocated above for
+    // the rest still hold whatever was on disk before; zero them
+    int done = amountWritten, n;
+    memset(buffer, 0, CopyTransferSize);
+    while (done < filled &&
+           (n = openFile->WriteAt(buffer, min(filled - done, CopyTransferSize), done)) > 0)
+        done += n;
     delete[] buffer;
 
     // Close the UNIX and the Nachos files
     delete openFile;
     Close(fd);
+    return amountWritten == fileLength;
+}
+
+//----------------------------------------------------------------------
+// CopyMany
+//      Copy the "count" UNIX files "from" into the Nachos directory
+//	"dir", each under the last part of its UNIX name, in a single
+//	boot of the kernel.
+//----------------------------------------------------------------------
+
+static void CopyMany(char **from, int count, char *dir)
+{
+    int copied = 0;
+
+    for (int i = 0; i < count; i++) {
+        char *name = strrchr(from[i], '/');
+        name = (name == NULL) ? from[i] : name + 1;
+        char *to = new char[strlen(dir) + strlen(name) + 2];
+        strcpy(to, dir);
+        if (to[strlen(to) - 1] != '/')
+            strcat(to, "/");
+        strcat(to, name);
+        if (Copy(from[i], to))
+            copied++;
+        delete[] to;
+    }
+    printf("Copied %d of %d files into %s\n", copied, count, dir);
 }
 
 #endif // FILESYS_STUB
@@ -157,6 +223,100 @@ static void CreateDirectory(char *name)
     kernel->fileSystem->create_directory(name);
 }
 
+#ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// RunCommand
+//      Run one batch command, given as the words "argv[0..argc-1]".
+//	The commands are spelled like the command line flags that do
+//	the same thing, plus "-e <nachos file>", which runs a user
+//	program and waits for it to exit.  Return FALSE if the command
+//	is not understood.
+//----------------------------------------------------------------------
+
+static bool RunCommand(int argc, char **argv)
+{
+    char *cmd = argv[0];
+
+    if (strcmp(cmd, "-cp") == 0 && argc == 3)
+        Copy(argv[1], argv[2]);
+    else if (strcmp(cmd, "-cpm") == 0 && argc >= 3)
+        CopyMany(&argv[1], argc - 2, argv[argc - 1]);
+    else if (strcmp(cmd, "-p") == 0 && argc == 2)
+        Print(argv[1]);
+    else if (strcmp(cmd, "-r") == 0 && argc == 2)
+        kernel->fileSystem->Remove(argv[1], false);
+    else if (strcmp(cmd, "-rr") == 0 && argc == 2)
+        kernel->fileSystem->Remove(argv[1], true);
+    else if (strcmp(cmd, "-l") == 0 && argc == 2)
+        kernel->fileSystem->List(argv[1], false);
+    else if (strcmp(cmd, "-lr") == 0 && argc == 2)
+        kernel->fileSystem->List(argv[1], true);
+    else if (strcmp(cmd, "-mkdir") == 0 && argc == 2)
+        CreateDirectory(argv[1]);
+    else if (strcmp(cmd, "-D") == 0 && argc == 1)
+        kernel->fileSystem->Print();
+    else if (strcmp(cmd, "-fsck") == 0 && argc == 1)
+        kernel->fileSystem->Check(TRUE);
+    else if (strcmp(cmd, "-e") == 0 && argc == 2) {
+        kernel->Exec(argv[1], TRUE);
+        kernel->programDone->P();
+    }
+    else
+        return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// RunBatch
+//      Run the commands in the UNIX file "name" ("-" means stdin), one
+//	per line, all in this kernel, so the disk is mounted once and
+//	the block cache stays warm from one command to the next.
+//	Blank lines and lines starting with '#' are skipped.
+//
+//	After each command, print the ticks it took and the disk I/O it
+//	did.
+//----------------------------------------------------------------------
+
+static const int BatchLineSize = 1024;
+static const int BatchMaxWords = 64;
+
+static void RunBatch(char *name)
+{
+    FILE *in = (strcmp(name, "-") == 0) ? stdin : fopen(name, "r");
+    char line[BatchLineSize];
+    char *words[BatchMaxWords];
+    int lineNum = 0;
+
+    if (in == NULL) {
+        printf("Batch: couldn't open %s\n", name);
+        return;
+    }
+    while (fgets(line, BatchLineSize, in) != NULL) {
+        int argc = 0;
+        lineNum++;
+        for (char *w = strtok(line, " \t\r\n"); w != NULL && argc < BatchMaxWords;
+             w = strtok(NULL, " \t\r\n"))
+            words[argc++] = w;
+        if (argc == 0 || words[0][0] == '#')
+            continue;
+
+        int ticks = kernel->stats->totalTicks;
+        int reads = kernel->stats->numDiskReads;
+        int writes = kernel->stats->numDiskWrites;
+        if (!RunCommand(argc, words)) {
+            printf("Batch: line %d: bad command %s\n", lineNum, words[0]);
+            continue;
+        }
+        printf("Batch: line %d: %s: ticks %d, disk reads %d, writes %d\n",
+               lineNum, words[0], kernel->stats->totalTicks - ticks,
+               kernel->stats->numDiskReads - reads,
+               kernel->stats->numDiskWrites - writes);
+    }
+    if (in != stdin)
+        fclose(in);
+}
+#endif // FILESYS_STUB
+
 //----------------------------------------------------------------------
 // main
 // 	Bootstrap the operating system kernel.
@@ -180,8 +340,12 @@ int main(int argc, char **argv)
     bool consoleTestFlag = false;
     bool networkTestFlag = false;
 #ifndef FILESYS_STUB
-    char *copyUnixFileName = NULL;   // UNIX file to be copied into Nachos
-    char *copyNachosFileName = NULL; // name of copied file in Nachos
+    char **copyUnixFileNames = new char *[argc]; // UNIX files to be copied into Nachos
+    char **copyNachosFileNames = new char *[argc]; // names of copied files in Nachos
+    int numCopies = 0;
+    char **copyManyFileNames = NULL; // UNIX files to be copied by -cpm
+    int numCopyMany = 0;
+    char *copyManyDirName = NULL;    // Nachos directory they go to
     char *printFileName = NULL;
     char *removeFileName = NULL;
     bool dirListFlag = false;
@@ -192,6 +356,8 @@ int main(int argc, char **argv)
     bool mkdirFlag = false;
     bool recursiveListFlag = false;
     bool recursiveRemoveFlag = false;
+    bool fsckFlag = false;
+    char *batchFileName = NULL;
 #endif //FILESYS_STUB
 
     // some command line arguments are handled here.
@@ -231,10 +397,23 @@ int main(int argc, char **argv)
         else if (strcmp(argv[i], "-cp") == 0)
         {
             ASSERT(i + 2 < argc);
-            copyUnixFileName = argv[i + 1];
-            copyNachosFileName = argv[i + 2];
+            copyUnixFileNames[numCopies] = argv[i + 1];
+            copyNachosFileNames[numCopies] = argv[i + 2];
+            numCopies++;
             i += 2;
         }
+        else if (strcmp(argv[i], "-cpm") == 0)
+        {
+            // every argument up to the next flag; the last is the directory
+            int last = i + 1;
+            while (last + 1 < argc && argv[last + 1][0] != '-')
+                last++;
+            ASSERT(last - i >= 2);
+            copyManyFileNames = &argv[i + 1];
+            numCopyMany = last - i - 1;
+            copyManyDirName = argv[last];
+            i = last;
+        }
         else if (strcmp(argv[i], "-p") == 0)
         {
             ASSERT(i + 1 < argc);
@@ -287,6 +466,16 @@ int main(int argc, char **argv)
         {
             dumpFlag = true;
         }
+        else if (strcmp(argv[i], "-fsck") == 0)
+        {
+            fsckFlag = true;
+        }
+        else if (strcmp(argv[i], "-b") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            batchFileName = argv[i + 1];
+            i++;
+        }
 #endif //FILESYS_STUB
         else if (strcmp(argv[i], "-u") == 0)
         {
@@ -295,8 +484,10 @@ int main(int argc, char **argv)
             cout << "Partial usage: nachos [-K] [-C] [-N]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpm UnixFile... NachosDirectory]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
-            cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-l] [-D] [-fsck]\n";
+            cout << "Partial usage: nachos [-b batchFile]\n";
 #endif //FILESYS_STUB
         }
     }
@@ -326,13 +517,21 @@ int main(int argc, char **argv)
     }
 
 #ifndef FILESYS_STUB
+    if (fsckFlag)
+    {
+        kernel->fileSystem->Check(TRUE);
+    }
     if (removeFileName != NULL)
     {
         kernel->fileSystem->Remove(removeFileName,recursiveRemoveFlag);
     }
-    if (copyUnixFileName != NULL && copyNachosFileName != NULL)
+    for (i = 0; i < numCopies; i++)
+    {
+        Copy(copyUnixFileNames[i], copyNachosFileNames[i]);
+    }
+    if (copyManyDirName != NULL)
     {
-        Copy(copyUnixFileName, copyNachosFileName);
+        CopyMany(copyManyFileNames, numCopyMany, copyManyDirName);
     }
     if (dumpFlag)
     {
@@ -351,6 +550,10 @@ int main(int argc, char **argv)
     {
         Print(printFileName);
     }
+    if (batchFileName != NULL)
+    {
+        RunBatch(batchFileName);
+    }
 #endif // FILESYS_STUB
 
     // finally, run an initial user program if requested to do so
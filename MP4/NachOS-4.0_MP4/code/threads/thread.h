@@ -43,6 +43,8 @@
 #include "machine.h"
 #include "addrspace.h"
 
+class Transaction;
+
 // CPU register state to be saved on context switch.  
 // The x86 needs to save only a few registers, 
 // SPARC and MIPS needs to save 10 registers, 
@@ -131,6 +133,8 @@ class Thread {
     void RestoreUserState();		// restore user-level register state
 
     AddrSpace *space;			// User code this thread is running.
+    Transaction *transaction;		// Journal operation it is inside,
+					// or NULL
 };
 
 // external function, dummy routine whose sole job is to call Thread::Print
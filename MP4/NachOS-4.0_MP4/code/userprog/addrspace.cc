@@ -79,16 +79,36 @@ AddrSpace::AddrSpace()
     
     // zero out the entire address space
     bzero(kernel->machine->mainMemory, MemorySize);
+
+    fdTable = new FdTable;
+
+    numPages = 0;
+    tableSize = NumPhysPages;
+    mapEnd = 0;
+    mappings = new List<MappedFile *>;
+    frameOwner = new int[NumPhysPages];
+    framePinned = new bool[NumPhysPages];
+    for (int i = 0; i < NumPhysPages; i++) {
+	frameOwner[i] = -1;
+	framePinned[i] = FALSE;
+    }
+    clockHand = 0;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.
+// 	Dealloate an address space, closing any files the program
+//	left open and writing back the files it left mapped.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
+   UnmapAll();
+   delete mappings;
+   delete [] frameOwner;
+   delete [] framePinned;
+   delete [] pageTable;
+   delete fdTable;
 }
 
 
@@ -134,6 +154,7 @@ AddrSpace::Load(char *fileName)
 #endif
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
+    mapEnd = numPages;			// mappings go above the stack
 
     ASSERT(numPages <= NumPhysPages);		// check we're not trying
 						// to run anything too big --
@@ -257,7 +278,271 @@ void AddrSpace::SaveState()
 void AddrSpace::RestoreState() 
 {
     kernel->machine->pageTable = pageTable;
-    kernel->machine->pageTableSize = numPages;
+    kernel->machine->pageTableSize = mapEnd;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Mmap
+//	Map the first "length" bytes of "file" into the address space,
+//	above the program and any earlier mappings.  Nothing is read
+//	yet: the new pages are invalid, and PageFault reads each one in
+//	from the file the first time the program touches it.  Bytes past
+//	the end of the file read as zeros, and the file grows if they
+//	are written back.
+//
+//	Return the virtual address of the mapping, or -1 if "length" is
+//	not positive or the program leaves no physical page to map into.
+//
+//	"file" -- the open file to map; the mapping opens its own copy
+//	"length" -- the number of bytes to map
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Mmap(OpenFile *file, int length)
+{
+    int pages = divRoundUp(length, PageSize);
+    unsigned int i;
+    MappedFile *map;
+
+    if (length <= 0 || numPages >= (unsigned)NumPhysPages)
+	return -1;
+    if (mapEnd + pages > tableSize) {	// grow at least twofold, so a
+	unsigned int size = 2 * tableSize; // run of maps copies rarely
+	TranslationEntry *table;
+
+	if (size < mapEnd + pages)
+	    size = mapEnd + pages;
+	table = new TranslationEntry[size];
+	for (i = 0; i < tableSize; i++)
+	    table[i] = pageTable[i];
+	delete [] pageTable;
+	pageTable = table;
+	tableSize = size;
+    }
+    for (i = mapEnd; i < mapEnd + pages; i++) {
+	pageTable[i].virtualPage = i;
+	pageTable[i].physicalPage = -1;
+	pageTable[i].valid = FALSE;	// read in on first touch
+	pageTable[i].use = FALSE;
+	pageTable[i].dirty = FALSE;
+	pageTable[i].readOnly = FALSE;
+    }
+
+    map = new MappedFile(new OpenFile(file->HeaderSector()), mapEnd, pages,
+			 length);
+    mappings->Append(map);
+    mapEnd += pages;
+    if (kernel->currentThread->space == this)
+	RestoreState();			// the page table may have moved
+    DEBUG(dbgAddr, "Mapped " << length << " bytes at page " << map->firstPage);
+    return map->firstPage * PageSize;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Munmap
+//	Remove the mapping starting at virtual address "addr", writing
+//	its dirty pages back to the file first.  If it was the highest
+//	mapping, the next Mmap reuses its pages; a hole below other
+//	mappings stays unused until they are removed too.
+//	Return FALSE if no mapping starts there.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Munmap(int addr)
+{
+    MappedFile *map = NULL;
+    ListIterator<MappedFile *> it(mappings);
+
+    for (; !it.IsDone(); it.Next())
+	if (it.Item()->firstPage * PageSize == addr)
+	    map = it.Item();
+    if (map == NULL)
+	return FALSE;
+
+    for (int i = map->firstPage; i < map->firstPage + map->numPages; i++)
+	if (pageTable[i].valid) {
+	    framePinned[pageTable[i].physicalPage] = FALSE;
+	    Evict(pageTable[i].physicalPage);
+	}
+    mappings->Remove(map);
+    delete map->file;
+    delete map;
+
+    mapEnd = numPages;			// lower to the highest mapping left
+    for (ListIterator<MappedFile *> left(mappings); !left.IsDone();
+	 left.Next())
+	if (left.Item()->firstPage + left.Item()->numPages > (int)mapEnd)
+	    mapEnd = left.Item()->firstPage + left.Item()->numPages;
+    if (kernel->currentThread->space == this)
+	RestoreState();			// stop translating the freed pages
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UnmapAll
+//	Remove every mapping, writing back dirty pages; called when the
+//	program exits.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::UnmapAll()
+{
+    while (!mappings->IsEmpty())
+	Munmap(mappings->Front()->firstPage * PageSize);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FindMapping
+//	Return the mapping holding virtual page "vpn", or NULL.
+//----------------------------------------------------------------------
+
+MappedFile *
+AddrSpace::FindMapping(int vpn)
+{
+    ListIterator<MappedFile *> it(mappings);
+
+    for (; !it.IsDone(); it.Next()) {
+	MappedFile *map = it.Item();
+	if (vpn >= map->firstPage && vpn < map->firstPage + map->numPages)
+	    return map;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageFault
+//	Handle a page fault at "virtAddr": if it is in a mapped file,
+//	read the page in, and the faulting instruction can be retried.
+//	Return FALSE if the address is not mapped at all.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageFault(int virtAddr)
+{
+    int vpn = (unsigned)virtAddr / PageSize;
+
+    if (vpn >= (int)mapEnd || pageTable[vpn].valid)
+	return FALSE;
+    return PageIn(vpn);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+//	Read mapped page "vpn" from its file into a physical page, found
+//	by FindFrame.  The file is read straight into the page; bytes
+//	past the end of the file, and holes, come out as zeros.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn(int vpn)
+{
+    MappedFile *map = FindMapping(vpn);
+    int frame, offset, n;
+    char *page;
+
+    if (map == NULL || (frame = FindFrame()) == -1)
+	return FALSE;
+    page = &kernel->machine->mainMemory[frame * PageSize];
+    offset = (vpn - map->firstPage) * PageSize;
+    n = map->file->ReadAt(page, min(PageSize, map->length - offset), offset);
+    bzero(page + n, PageSize - n);
+
+    pageTable[vpn].physicalPage = frame;
+    pageTable[vpn].valid = TRUE;
+    pageTable[vpn].use = FALSE;
+    pageTable[vpn].dirty = FALSE;
+    frameOwner[frame] = vpn;
+    kernel->stats->numPageFaults++;
+    DEBUG(dbgAddr, "Paged in " << vpn << " to frame " << frame);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FindFrame
+//	Return a physical page to hold a mapped page.  Only the pages
+//	above the program are used (it is loaded at virtual = physical).
+//	The clock hand sweeps them, taking the first free one, or the
+//	first one not used since the last sweep, which is written back.
+//	Pinned pages are skipped; return -1 if every page is pinned.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::FindFrame()
+{
+    int frames = NumPhysPages - numPages;
+
+    for (int i = 0; i < 2 * frames; i++) {	// the second sweep finds
+	int frame = numPages + clockHand;	// the use bits cleared
+	clockHand = (clockHand + 1) % frames;
+
+	if (framePinned[frame])
+	    continue;
+	if (frameOwner[frame] == -1)
+	    return frame;
+	if (pageTable[frameOwner[frame]].use) {
+	    pageTable[frameOwner[frame]].use = FALSE;	// second chance
+	} else {
+	    Evict(frame);
+	    return frame;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Evict
+//	Unmap the mapped page held in physical page "frame", writing it
+//	back to its file if the program changed it.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Evict(int frame)
+{
+    int vpn = frameOwner[frame];
+    MappedFile *map = FindMapping(vpn);
+
+    ASSERT(map != NULL && !framePinned[frame]);
+    if (pageTable[vpn].dirty) {
+	int offset = (vpn - map->firstPage) * PageSize;
+	map->file->WriteAt(&kernel->machine->mainMemory[frame * PageSize],
+			   min(PageSize, map->length - offset), offset);
+    }
+    pageTable[vpn].valid = FALSE;
+    pageTable[vpn].dirty = FALSE;
+    frameOwner[frame] = -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Pin
+//	Called by system calls before they use a user buffer: if the page
+//	holding "virtAddr" is mapped, read it in if need be, and keep it
+//	in memory until UnpinAll, so bringing in a later page of the same
+//	buffer cannot push it out.  Return FALSE if it cannot be read in.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Pin(int virtAddr)
+{
+    int vpn = (unsigned)virtAddr / PageSize;
+
+    if (vpn < (int)numPages || vpn >= (int)mapEnd)
+	return TRUE;			// not a mapped page
+    if (!pageTable[vpn].valid && !PageIn(vpn))
+	return FALSE;
+    framePinned[pageTable[vpn].physicalPage] = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UnpinAll
+//	Let the pages pinned by Pin be replaced again.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::UnpinAll()
+{
+    for (int i = 0; i < NumPhysPages; i++)
+	framePinned[i] = FALSE;
 }
 
 
@@ -6,6 +6,12 @@
 //	The user level CPU state is saved and restored in the thread
 //	executing the user program (see thread.h).
 //
+//	Files can be mapped into an address space with Mmap.  They are
+//	placed above the program, and their pages are only read in when
+//	the program first touches them, into the physical pages the
+//	program does not use; when those run out, a page is picked by
+//	the clock algorithm and written back to the file if it is dirty.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -15,9 +21,25 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "fdtable.h"
+#include "list.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
 
+// A file mapped into an address space by Mmap.
+
+class MappedFile {
+  public:
+    MappedFile(OpenFile *f, int first, int pages, int len) {
+	file = f; firstPage = first; numPages = pages; length = len; }
+
+    OpenFile *file;			// The mapping's own OpenFile on the
+					// file, so closing the id is safe
+    int firstPage;			// First virtual page of the mapping
+    int numPages;			// Number of pages it covers
+    int length;				// Number of bytes of the file it covers
+};
+
 class AddrSpace {
   public:
     AddrSpace();			// Create an address space.
@@ -39,11 +61,44 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    FdTable *fdTable;			// Files the program has open; shared
+					// by all of its threads
+
+    int Mmap(OpenFile *file, int length); // Map the first "length" bytes
+					// of "file"; return the virtual
+					// address, or -1
+    bool Munmap(int addr);		// Write back and remove the mapping
+					// at "addr"
+    void UnmapAll();			// ... all of them, on exit
+    bool PageFault(int virtAddr);	// Read in the mapped page holding
+					// "virtAddr"; FALSE if it is not in
+					// a mapping
+    bool Pin(int virtAddr);		// Keep the page holding "virtAddr"
+					// in memory, reading it in if it is
+					// mapped, while the kernel uses it
+    void UnpinAll();			// Let pinned pages be replaced again
+    int Size() { return mapEnd * PageSize; } // Bytes of virtual
+					// address space, mappings included
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    unsigned int tableSize;		// Number of entries in pageTable
+    unsigned int mapEnd;		// Page after the last mapping
+
+    List<MappedFile *> *mappings;	// The files mapped in
+    int *frameOwner;			// Virtual page in each physical page
+					// used for mappings, or -1
+    bool *framePinned;			// Which of those are pinned
+    int clockHand;			// Next frame the clock looks at
+
+    MappedFile *FindMapping(int vpn);	// The mapping holding page "vpn"
+    bool PageIn(int vpn);		// Read in mapped page "vpn"
+    int FindFrame();			// A physical page for a mapped page,
+					// replacing one if need be
+    void Evict(int frame);		// Write back and unmap a mapped page
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
@@ -80,9 +80,7 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Create: /// MP4 mod(2) Implement five system calls:  
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				//cout << filename << endl;
-				status = SysCreate(filename);
+				status = SysCreate(val, 0);
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -120,15 +118,14 @@ void ExceptionHandler(ExceptionType which)
 			DEBUG(dbgAddr, "Program exit\n");
 			val = kernel->machine->ReadRegister(4);
 			cout << "return value:" << val << endl;
+			kernel->ProgramExit();	// closes its files too
 			kernel->currentThread->Finish();
 			break;
 		case SC_Create:
 			val = kernel->machine->ReadRegister(4);
 			{
-			char *filename = &(kernel->machine->mainMemory[val]);
-			//cout << filename << endl;
 			int filesize = kernel->machine->ReadRegister(5);///MP4
-			status = SysCreate(filename, filesize);
+			status = SysCreate(val, filesize);
 			kernel->machine->WriteRegister(2, (int) status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -140,9 +137,7 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Open: /// MP4 mod(2) Implement five system calls: 
 			val = kernel->machine->ReadRegister(4);
 			{
-			char *filename = &(kernel->machine->mainMemory[val]);
-
-			int fileID = SysOpen(filename);
+			int fileID = SysOpen(val);
 			kernel->machine->WriteRegister(2, (int) fileID);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -163,13 +158,37 @@ void ExceptionHandler(ExceptionType which)
             return;
             ASSERTNOTREACHED();
 			break;
+		case SC_Seek:
+			{
+            val = kernel->machine->ReadRegister(4);
+            int fileID = kernel->machine->ReadRegister(5);
+            status = SysSeek(val, fileID);
+            kernel->machine->WriteRegister(2, (int) status);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_Remove:
+			val = kernel->machine->ReadRegister(4);
+			{
+			status = SysRemove(val);
+			kernel->machine->WriteRegister(2, (int) status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+			return;
+			ASSERTNOTREACHED();
+			break;
 		case SC_Read: ///MP4 mod
 			{
             val = kernel->machine->ReadRegister(4);
             int size = kernel->machine->ReadRegister(5);
             int fileID = kernel->machine->ReadRegister(6);
-            char* buffer = &(kernel->machine->mainMemory[val]);
-            int numChar = SysRead(buffer, size, fileID);
+            int numChar = SysRead(val, size, fileID);
             kernel->machine->WriteRegister(2, (int) numChar);
             }
             kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -183,8 +202,21 @@ void ExceptionHandler(ExceptionType which)
             val = kernel->machine->ReadRegister(4);
             int size = kernel->machine->ReadRegister(5);
             int fileID = kernel->machine->ReadRegister(6);
-            char *buffer = &(kernel->machine->mainMemory[val]);
-            int numChar = SysWrite(buffer, size, fileID);
+            int numChar = SysWrite(val, size, fileID);
+            kernel->machine->WriteRegister(2, (int) numChar);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_ReadV:
+			{
+            val = kernel->machine->ReadRegister(4);
+            int count = kernel->machine->ReadRegister(5);
+            int fileID = kernel->machine->ReadRegister(6);
+            int numChar = SysReadV(val, count, fileID);
             kernel->machine->WriteRegister(2, (int) numChar);
             }
             kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -193,11 +225,95 @@ void ExceptionHandler(ExceptionType which)
             return;
             ASSERTNOTREACHED();
 			break;
+		case SC_WriteV:
+			{
+            val = kernel->machine->ReadRegister(4);
+            int count = kernel->machine->ReadRegister(5);
+            int fileID = kernel->machine->ReadRegister(6);
+            int numChar = SysWriteV(val, count, fileID);
+            kernel->machine->WriteRegister(2, (int) numChar);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_PRead:
+			{
+            val = kernel->machine->ReadRegister(4);
+            int size = kernel->machine->ReadRegister(5);
+            int position = kernel->machine->ReadRegister(6);
+            int fileID = kernel->machine->ReadRegister(7);
+            int numChar = SysPRead(val, size, position, fileID);
+            kernel->machine->WriteRegister(2, (int) numChar);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_PWrite:
+			{
+            val = kernel->machine->ReadRegister(4);
+            int size = kernel->machine->ReadRegister(5);
+            int position = kernel->machine->ReadRegister(6);
+            int fileID = kernel->machine->ReadRegister(7);
+            int numChar = SysPWrite(val, size, position, fileID);
+            kernel->machine->WriteRegister(2, (int) numChar);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_Mmap:
+			{
+            val = kernel->machine->ReadRegister(4);
+            int length = kernel->machine->ReadRegister(5);
+            int addr = SysMmap(val, length);
+            kernel->machine->WriteRegister(2, addr);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_Munmap:
+			{
+            val = kernel->machine->ReadRegister(4);
+            status = SysMunmap(val);
+            kernel->machine->WriteRegister(2, (int) status);
+            }
+            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+            kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+            kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+            return;
+            ASSERTNOTREACHED();
+			break;
+		case SC_Sync:
+			DEBUG(dbgSys, "Sync\n");
+			SysSync();
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+			return;
+			ASSERTNOTREACHED();
+			break;
 		default:
 			cerr << "Unexpected system call " << type << "\n";
 			break;
 		}
 		break;
+	case PageFaultException:
+		val = kernel->machine->ReadRegister(BadVAddrReg);
+		if (kernel->currentThread->space->PageFault(val))
+			return;		// page of a mapped file read in; retry
+		cerr << "Page fault at " << val << "\n";
+		break;
 	default:
 		cerr << "Unexpected user mode exception " << (int)which << "\n";
 		break;
@@ -0,0 +1,125 @@
+// fdtable.cc 
+//	Routines to manage a user program's table of open files.
+//
+//	The free slots form a list: nextFree[i] is the free slot after
+//	slot i.  Add takes the head of the list, Close pushes the slot
+//	back, and Grow puts the new slots on the list.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fdtable.h"
+#include "openfile.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// FdTable::FdTable
+//      Create an empty table of FdTableInitialSize slots, all free.
+//----------------------------------------------------------------------
+
+FdTable::FdTable()
+{
+    files = NULL;
+    nextFree = NULL;
+    freeHead = -1;
+    size = 0;
+    Grow();
+}
+
+//----------------------------------------------------------------------
+// FdTable::~FdTable
+//      Close every file the program left open.
+//----------------------------------------------------------------------
+
+FdTable::~FdTable()
+{
+    for (int i = 0; i < size; i++)
+	if (files[i] != NULL)
+	    delete files[i];
+    delete [] files;
+    delete [] nextFree;
+}
+
+//----------------------------------------------------------------------
+// FdTable::Grow
+//      Double the number of slots, putting the new ones on the free
+//	list lowest first.
+//----------------------------------------------------------------------
+
+void
+FdTable::Grow()
+{
+    int newSize = (size == 0) ? FdTableInitialSize : 2 * size;
+    OpenFile **newFiles = new OpenFile *[newSize];
+    int *newNext = new int[newSize];
+
+    for (int i = 0; i < size; i++) {
+	newFiles[i] = files[i];
+	newNext[i] = nextFree[i];
+    }
+    for (int i = size; i < newSize; i++) {
+	newFiles[i] = NULL;
+	newNext[i] = (i + 1 < newSize) ? i + 1 : freeHead;
+    }
+    freeHead = size;
+    delete [] files;
+    delete [] nextFree;
+    files = newFiles;
+    nextFree = newNext;
+    size = newSize;
+}
+
+//----------------------------------------------------------------------
+// FdTable::Add
+//      Put "file" in a free slot, growing the table if there is none,
+//	and return its id.  The table now owns "file".
+//----------------------------------------------------------------------
+
+int
+FdTable::Add(OpenFile *file)
+{
+    int slot;
+
+    ASSERT(file != NULL);
+    if (freeHead == -1)
+	Grow();
+    slot = freeHead;
+    freeHead = nextFree[slot];
+    files[slot] = file;
+    return slot + 1;
+}
+
+//----------------------------------------------------------------------
+// FdTable::Get
+//      Return the open file with id "id", or NULL if there is none.
+//----------------------------------------------------------------------
+
+OpenFile *
+FdTable::Get(int id)
+{
+    if (id < 1 || id > size)
+	return NULL;
+    return files[id - 1];
+}
+
+//----------------------------------------------------------------------
+// FdTable::Close
+//      Close the file with id "id" and put its slot back on the free
+//	list.  Return FALSE if no file has that id.
+//----------------------------------------------------------------------
+
+bool
+FdTable::Close(int id)
+{
+    OpenFile *file = Get(id);
+
+    if (file == NULL)
+	return FALSE;
+    delete file;
+    files[id - 1] = NULL;
+    nextFree[id - 1] = freeHead;
+    freeHead = id - 1;
+    return TRUE;
+}
@@ -0,0 +1,46 @@
+// fdtable.h 
+//	Data structures for a user program's table of open files.
+//
+//	Each address space has its own table, so programs running side by
+//	side each number their files from 1 without getting in each
+//	other's way.  The table starts small and doubles when it fills.
+//	Free slots are kept on a list threaded through the table, so
+//	opening and closing a file are constant time.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FDTABLE_H
+#define FDTABLE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+class OpenFile;
+
+#define FdTableInitialSize 16	// slots in a new table
+
+// The following class maps the OpenFileIds a user program sees to
+// the kernel's OpenFile objects.  Ids start at 1; slot i holds id i + 1.
+
+class FdTable {
+  public:
+    FdTable();			// Create an empty table
+    ~FdTable();			// Close every file still open
+
+    int Add(OpenFile *file);	// Give "file" an id, and return it
+    OpenFile *Get(int id);	// The file with id "id", or NULL
+    bool Close(int id);		// Close the file, and free its id;
+				// FALSE if "id" is not open
+
+  private:
+    OpenFile **files;		// The open files, NULL in free slots
+    int *nextFree;		// For a free slot, the next free one
+    int freeHead;		// First free slot, or -1 if full
+    int size;			// Number of slots
+
+    void Grow();		// Double the number of slots
+};
+
+#endif // FDTABLE_H
@@ -14,6 +14,7 @@
 #include "kernel.h"
 
 #include "synchconsole.h"
+#include "pathcache.h"
 
 void SysHalt()
 {
@@ -24,38 +25,205 @@ int SysAdd(int op1, int op2)
 {
 	return op1 + op2;
 }
-int SysOpen(char* filename){
-	OpenFile* open_file;
-	open_file = kernel->fileSystem->Open(filename);
-	int index = -1;
-	for(int i=0;i<20;i++){
-		if(kernel->fileSystem->fileDescriptorTable[i] == NULL){
-			index = i;
-			break;
+// The open files of the program making the system call
+FdTable *CurrentFiles(){
+	return kernel->currentThread->space->fdTable;
+}
+
+// Append the pieces of physical memory the "len" byte user buffer at
+// virtual address "addr" is mapped to onto "spans", from "*count" on;
+// pages that follow each other in memory make one piece.  Needs room
+// for len / PageSize + 2 pieces.  Pages of mapped files are read in
+// and pinned; the caller unpins them when done.  Returns FALSE if part
+// of the buffer is not mapped.
+bool UserSpans(int addr, int len, bool writing, IoSpan *spans, int *count){
+	int done = 0;
+	while(done < len){
+		int span;
+		if(!kernel->currentThread->space->Pin(addr + done))return FALSE;
+		char *buf = kernel->machine->UserSpan(addr + done, len - done, writing, &span);
+		if(buf == NULL)return FALSE; ///not mapped
+		if(*count > 0 && spans[*count-1].buf + spans[*count-1].len == buf)
+			spans[*count-1].len += span;
+		else{
+			spans[*count].buf = buf;
+			spans[*count].len = span;
+			(*count)++;
 		}
+		done += span;
 	}
-	//cout<<"ava index: "<<index<<"\n";
-	if(index==-1)return -1; ///full
-	else kernel->fileSystem->fileDescriptorTable[index] = open_file;
-	return index+1; //since need larger than 0 
+	return TRUE;
+}
+
+// Fetch the word at user address "addr"; FALSE if it is not mapped
+bool FetchUserWord(int addr, int *value){
+	int span;
+	char *p = kernel->machine->UserSpan(addr, 4, FALSE, &span);
+	if(p == NULL && kernel->currentThread->space->PageFault(addr))
+		p = kernel->machine->UserSpan(addr, 4, FALSE, &span); ///mapped file
+	if(p == NULL || span < 4)return FALSE;
+	*value = WordToHost(*(unsigned int *)p);
+	return TRUE;
+}
+
+// Copy the string at user address "addr" into "buf", which holds
+// "size" bytes; FALSE if part of it is not mapped, or it does not fit
+bool FetchUserString(int addr, char *buf, int size){
+	int done = 0;
+	while(done < size){
+		int span;
+		char *p = kernel->machine->UserSpan(addr + done, size - done, FALSE, &span);
+		if(p == NULL && kernel->currentThread->space->PageFault(addr + done))
+			p = kernel->machine->UserSpan(addr + done, size - done, FALSE, &span); ///mapped file
+		if(p == NULL)return FALSE; ///not mapped
+		for(int i=0;i<span;i++){
+			buf[done] = p[i];
+			if(buf[done++] == '\0')return TRUE;
+		}
+	}
+	return FALSE; ///too long
+}
+
+// Is the "len" byte user buffer at "addr" inside the address space?
+// Checked before anything is sized from "len", so that a huge "len"
+// cannot make the kernel allocate more than a program could map.
+bool InUserSpace(int addr, int len){
+	int top = kernel->currentThread->space->Size();
+	return addr >= 0 && len >= 0 && addr <= top && len <= top - addr;
+}
+
+// Open the file named by the string at user address "addr"
+int SysOpen(int addr){
+	char filename[PathNameMaxLen + 1];
+	OpenFile* open_file;
+	if(!FetchUserString(addr, filename, PathNameMaxLen + 1))return -1;
+	open_file = kernel->fileSystem->Open(filename);
+	if(open_file == NULL)return -1; ///not found
+	return CurrentFiles()->Add(open_file); ///ids start at 1
 }
-int SysCreate(char *filename, int filesize)
+
+// Create the file named by the string at user address "addr"
+int SysCreate(int addr, int filesize)
 {
+	char filename[PathNameMaxLen + 1];
 	// return value
 	// 1: success
 	// 0: failed
+	if(!FetchUserString(addr, filename, PathNameMaxLen + 1))return 0;
 	return kernel->fileSystem->Create(filename,filesize);
 }
-int SysWrite(char *buf, int len, int id){
-	return kernel->fileSystem->Write(buf,len,id);
+
+// Move data between file "id" and "spans" in one request, at the seek
+// position, or at "position" if it is not -1
+int FileTransfer(IoSpan *spans, int count, int position, int id, bool reading){
+	OpenFile* file = CurrentFiles()->Get(id);
+	if(file == NULL)return -1; ///not open
+	if(position == -1){
+		if(reading)return file->ReadV(spans, count);
+		return file->WriteV(spans, count);
+	}
+	if(reading)return file->ReadAtV(spans, count, position);
+	return file->WriteAtV(spans, count, position);
+}
+
+// Move "len" bytes between file "id" and the user buffer at virtual
+// address "addr", straight to or from the frames the buffer is mapped
+// to.  Returns the number of bytes moved, or -1 (bad id, bad position
+// or unmapped buffer).
+int SysTransfer(int addr, int len, int position, int id, bool reading){
+	if(!InUserSpace(addr, len))return -1;
+	IoSpan *spans = new IoSpan[len / PageSize + 2];
+	int count = 0;
+	int result = -1;
+	if(UserSpans(addr, len, reading, spans, &count))
+		result = FileTransfer(spans, count, position, id, reading);
+	kernel->currentThread->space->UnpinAll();
+	delete [] spans;
+	return result;
+}
+
+// The same for the "iovCount" buffers described by the IoVec array at
+// "iov", all moved in one request
+int SysTransferV(int iov, int iovCount, int id, bool reading){
+	int base[MaxIoVec], len[MaxIoVec];
+	int pieces = 0;
+	if(iovCount < 0 || iovCount > MaxIoVec)return -1;
+	for(int i=0;i<iovCount;i++){
+		if(!FetchUserWord(iov + 8*i, &base[i]) ||
+		   !FetchUserWord(iov + 8*i + 4, &len[i]) ||
+		   !InUserSpace(base[i], len[i]))
+			return -1;
+		pieces += len[i] / PageSize + 2;
+	}
+	IoSpan *spans = new IoSpan[pieces + 1];
+	int count = 0;
+	int result = -1;
+	int i;
+	for(i=0;i<iovCount;i++)
+		if(!UserSpans(base[i], len[i], reading, spans, &count))break;
+	if(i == iovCount)
+		result = FileTransfer(spans, count, -1, id, reading);
+	kernel->currentThread->space->UnpinAll();
+	delete [] spans;
+	return result;
+}
+
+int SysWrite(int addr, int len, int id){
+	return SysTransfer(addr, len, -1, id, FALSE);
+}
+
+int SysRead(int addr, int len, int id){
+	return SysTransfer(addr, len, -1, id, TRUE);
+}
+
+int SysWriteV(int iov, int count, int id){
+	return SysTransferV(iov, count, id, FALSE);
+}
+
+int SysReadV(int iov, int count, int id){
+	return SysTransferV(iov, count, id, TRUE);
+}
+
+int SysPWrite(int addr, int len, int position, int id){
+	if(position < 0)return -1;
+	return SysTransfer(addr, len, position, id, FALSE);
 }
 
-int SysRead(char *buf, int len, int id){
-	return kernel->fileSystem->Read(buf,len,id);
+int SysPRead(int addr, int len, int position, int id){
+	if(position < 0)return -1;
+	return SysTransfer(addr, len, position, id, TRUE);
 }
 
 int SysClose(int id){
-	return kernel->fileSystem->Close(id);
+	return CurrentFiles()->Close(id);
+}
+
+int SysSeek(int position, int id){
+	OpenFile* file = CurrentFiles()->Get(id);
+	if(file == NULL || position < 0)return -1;
+	file->Seek(position);
+	return 1;
+}
+
+int SysMmap(int id, int length){
+	OpenFile* file = CurrentFiles()->Get(id);
+	if(file == NULL)return -1;
+	return kernel->currentThread->space->Mmap(file, length);
+}
+
+int SysMunmap(int addr){
+	return kernel->currentThread->space->Munmap(addr);
+}
+
+// Remove the file named by the string at user address "addr"
+int SysRemove(int addr){
+	char filename[PathNameMaxLen + 1];
+	if(!FetchUserString(addr, filename, PathNameMaxLen + 1))return 0;
+	return kernel->fileSystem->Remove(filename, false);
+}
+
+void SysSync(){
+	kernel->fileSystem->Sync();
 }
 #ifdef FILESYS_STUB
 #endif
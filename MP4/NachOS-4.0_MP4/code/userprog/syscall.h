@@ -34,6 +34,13 @@
 #define SC_ExecV	13
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
+#define SC_Sync		16
+#define SC_ReadV	17
+#define SC_WriteV	18
+#define SC_PRead	19
+#define SC_PWrite	20
+#define SC_Mmap		21
+#define SC_Munmap	22
 #define SC_Add		42
 #define SC_MSG		100
 
@@ -119,10 +126,12 @@ typedef int OpenFileId;
 int Create(char *name, int size); // FILE_SYS
 
 /* Remove a Nachos file, with name "name" */
+/* Return 1 on success, 0 if there is no such file */
 int Remove(char *name);
 
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
- * be used to read and write to the file.
+ * be used to read and write to the file.  Each program numbers its
+ * open files separately, from 1 up.
  */
 OpenFileId Open(char *name);
 
@@ -142,6 +151,7 @@ int Read(char *buffer, int size, OpenFileId id);
 
 /* Set the seek position of the open file "id"
  * to the byte "position".
+ * Return 1 on success, negative error code on failure
  */
 int Seek(int position, OpenFileId id);
 
@@ -150,6 +160,48 @@ int Seek(int position, OpenFileId id);
  */
 int Close(OpenFileId id);
 
+/* Write every modified disk sector the kernel is caching back to disk.
+ */
+void Sync();
+
+/* One buffer of a ReadV/WriteV request: "size" bytes at "buffer". */
+typedef struct {
+    char *buffer;
+    int size;
+} IoVec;
+
+#define MaxIoVec	16	/* most buffers in one ReadV/WriteV */
+
+/* Read from the open file into the "count" buffers described by "iov",
+ * filling each before going on to the next, or write the buffers out one
+ * after the other, as if by a single Read or Write.
+ * Return the total number of bytes read or written; on failure, a
+ * negative error code is returned.
+ */
+int ReadV(IoVec *iov, int count, OpenFileId id);
+int WriteV(IoVec *iov, int count, OpenFileId id);
+
+/* Read or write "size" bytes at byte "position" of the open file,
+ * leaving its seek position alone.
+ * Return the number of bytes actually read or written; on failure, a
+ * negative error code is returned.
+ */
+int PRead(char *buffer, int size, int position, OpenFileId id);
+int PWrite(char *buffer, int size, int position, OpenFileId id);
+
+/* Map the first "length" bytes of the open file "id" into memory, and
+ * return the address they start at, or a negative error code.  Pages
+ * are read from the file when first touched, and changes are written
+ * back by Munmap or when the program exits.  Closing "id" does not
+ * remove the mapping.
+ */
+char *Mmap(OpenFileId id, int length);
+
+/* Write back and remove the mapping starting at "addr".
+ * Return 1 on success, 0 if no mapping starts there.
+ */
+int Munmap(char *addr);
+
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 